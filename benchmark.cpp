@@ -0,0 +1,389 @@
+//Benchmark of the rasterization and transform kernels
+//CPU only, no window: g++ -O2 benchmark.cpp -pthread -o benchmark && ./benchmark > results.json
+//Every kernel is swept over its parameters and reported as one JSON record
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include "lines.h"
+#include "circle.h"
+#include "transform.h"
+#include "tiles.h"
+#include "wu.h"
+
+// Every heap allocation in the process is counted, so a kernel's allocations per call is the
+// difference across its calls. The replacements stay out of line so the compiler does not
+// pair the inlined malloc/free with the new/delete expressions.
+std::atomic<size_t> allocations{0};
+
+#if defined(_MSC_VER)
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+BENCHMARK_NOINLINE void* operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+BENCHMARK_NOINLINE void* operator new[](size_t size){
+    return operator new(size);
+}
+
+BENCHMARK_NOINLINE void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+BENCHMARK_NOINLINE void operator delete[](void* p) noexcept{
+    std::free(p);
+}
+
+BENCHMARK_NOINLINE void operator delete(void* p, size_t) noexcept{
+    std::free(p);
+}
+
+BENCHMARK_NOINLINE void operator delete[](void* p, size_t) noexcept{
+    std::free(p);
+}
+
+struct Result{
+    std::string kernel;
+    std::string params;
+    size_t calls;
+    double secondsPerCall;
+    double itemsPerSecond;
+    double pixelsPerSecond;
+    double allocationsPerCall;
+    std::string extra;
+};
+
+std::vector<Result> results;
+double minSeconds = 0.05;
+
+// Calls run() after one warm up call until minSeconds have passed. run returns the pixels
+// (or points) it produced; items is the number of segments, circles or points per call.
+template<typename Run>
+void measure(const std::string& kernel, const std::string& params, size_t items, Run run){
+    run();
+
+    size_t calls = 0, pixels = 0;
+    size_t allocationsBefore = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while(calls < 3 || elapsed < minSeconds){
+        pixels += run();
+        calls++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    size_t allocated = allocations.load() - allocationsBefore;
+
+    results.push_back({kernel, params, calls, elapsed / calls, items * calls / elapsed,
+                       pixels / elapsed, (double)allocated / calls, ""});
+    std::cerr << kernel << " " << params << ": " << pixels / elapsed << " pixels/s\n";
+}
+
+size_t runPixels(const RunBatch& batch){
+    size_t pixels = 0;
+    for(const Run& r : batch.runs) pixels += r.length;
+    return pixels;
+}
+
+// Segments of a given length from random starts, with slopes from one distribution
+std::vector<Segment> makeSegments(size_t n, int length, const std::string& slope, std::mt19937& rng){
+    std::uniform_int_distribution<int> coord(0, 799);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<Segment> segments(n);
+    for(auto& s : segments){
+        float angle;
+        if(slope == "shallow") angle = unit(rng) * 0.12f;
+        else if(slope == "diagonal") angle = 0.785f + unit(rng) * 0.05f;
+        else if(slope == "steep") angle = 1.571f + unit(rng) * 0.12f;
+        else angle = unit(rng) * 3.1416f;
+
+        s.x1 = coord(rng);
+        s.y1 = coord(rng);
+        s.x2 = s.x1 + (int)std::lround(length * std::cos(angle));
+        s.y2 = s.y1 + (int)std::lround(length * std::sin(angle));
+    }
+    return segments;
+}
+
+void lineBenchmarks(std::mt19937& rng){
+    for(int length : {8, 64, 512}){
+        for(std::string slope : {"shallow", "diagonal", "steep", "mixed"}){
+            for(size_t batchSize : {size_t(100), size_t(10000)}){
+                std::vector<Segment> segments = makeSegments(batchSize, length, slope, rng);
+                std::ostringstream params;
+                params << "{\"length\": " << length << ", \"slope\": \"" << slope << "\", \"batch\": " << batchSize << "}";
+
+                measure("bresenhamLine", params.str(), batchSize, [&]{
+                    std::vector<float> points;
+                    for(auto& s : segments) bresenhamLine(s.x1, s.y1, s.x2, s.y2, points);
+                    return points.size() / 3;
+                });
+
+                LineBatch batch;
+                measure("bresenhamBatch", params.str(), batchSize, [&]{
+                    bresenhamBatch(segments, batch);
+                    return batch.vertices.size() / 3;
+                });
+                measure("ddaBatch scalar", params.str(), batchSize, [&]{
+                    ddaBatch<false>(segments, batch);
+                    return batch.vertices.size() / 3;
+                });
+                measure("ddaBatch simd", params.str(), batchSize, [&]{
+                    ddaBatch(segments, batch);
+                    return batch.vertices.size() / 3;
+                });
+                CoverageBatch coverage;
+                measure("wuBatch scalar", params.str(), batchSize, [&]{
+                    wuBatch<false>(segments, coverage);
+                    return coverage.size();
+                });
+                measure("wuBatch simd", params.str(), batchSize, [&]{
+                    wuBatch(segments, coverage);
+                    return coverage.size();
+                });
+                measure("bresenhamRunBatch", params.str(), batchSize, [&]{
+                    return runPixels(bresenhamRunBatch(segments));
+                });
+                measure("ddaRunBatch", params.str(), batchSize, [&]{
+                    return runPixels(ddaRunBatch(segments));
+                });
+            }
+        }
+    }
+}
+
+void circleBenchmarks(std::mt19937& rng){
+    std::uniform_int_distribution<int> coord(0, 799);
+
+    for(int radius : {4, 32, 256}){
+        for(size_t batchSize : {size_t(100), size_t(10000)}){
+            std::vector<Circle> circles(batchSize);
+            for(auto& c : circles) c = {coord(rng), coord(rng), radius};
+            std::ostringstream params;
+            params << "{\"radius\": " << radius << ", \"batch\": " << batchSize << "}";
+
+            measure("midpointCircle", params.str(), batchSize, [&]{
+                size_t points = 0;
+                for(auto& c : circles) points += midpointCircle(c.xc, c.yc, c.r).size() / 3;
+                return points;
+            });
+
+            LineBatch contours;
+            measure("circleBatch", params.str(), batchSize, [&]{
+                circleBatch(circles, contours);
+                return contours.vertices.size() / 3;
+            });
+
+            RunBatch spans;
+            measure("circleSpanBatch", params.str(), batchSize, [&]{
+                circleSpanBatch(circles, spans);
+                return runPixels(spans);
+            });
+        }
+    }
+}
+
+void transformBenchmarks(std::mt19937& rng){
+    std::uniform_real_distribution<float> coord(-1.0f, 1.0f), angle(-720.0f, 720.0f);
+
+    for(size_t batchSize : {size_t(1000), size_t(1000000)}){
+        std::vector<Point> points(batchSize);
+        for(auto& p : points) p = {coord(rng), coord(rng)};
+        std::vector<float> angles(batchSize);
+        for(auto& a : angles) a = angle(rng);
+        PointBuffer source = toPointBuffer(points), buffer;
+
+        std::ostringstream params;
+        params << "{\"batch\": " << batchSize << "}";
+
+        // The per point functions as the programs call them, into a new vector
+        measure("translate", params.str(), batchSize, [&]{
+            PROFILE_ZONE(zone, "translate");
+            std::vector<Point> out;
+            for(auto& p : points) out.push_back(translate(p, 0.2f, 0.0f));
+            zone.points(points.size());
+            zone.bytes(grownBytes(out, 0));
+            return out.size();
+        });
+        measure("scaling", params.str(), batchSize, [&]{
+            PROFILE_ZONE(zone, "scaling");
+            std::vector<Point> out;
+            for(auto& p : points) out.push_back(scaling(p, 1.0f, 0.5f, 0.0f, 0.0f));
+            zone.points(points.size());
+            zone.bytes(grownBytes(out, 0));
+            return out.size();
+        });
+        measure("rotateFixed", params.str(), batchSize, [&]{
+            PROFILE_ZONE(zone, "rotateFixed");
+            std::vector<Point> out;
+            for(auto& p : points) out.push_back(rotateFixed(p, 30.0f, 0.1f, 0.1f));
+            zone.points(points.size());
+            zone.bytes(grownBytes(out, 0));
+            return out.size();
+        });
+
+        Affine m = affineRotate(30.0f, 0.1f, 0.1f) * affineScale(1.0f, 0.5f, 0.0f, 0.0f) * affineTranslate(0.2f, 0.0f);
+        measure("applyAffine", params.str(), batchSize, [&]{
+            applyAffine(m, source, buffer);
+            return buffer.size();
+        });
+        measure("rotatePoints", params.str(), batchSize, [&]{
+            buffer = source;
+            rotatePoints(buffer, angles.data(), 0.1f, 0.1f);
+            return buffer.size();
+        });
+    }
+}
+
+// Rectangles of a given size in pixels as indexed triangle pairs, the layout of rectangle.cpp
+void triangleBenchmarks(std::mt19937& rng){
+    std::uniform_real_distribution<float> center(-1.0f, 1.0f), angle(0.0f, 6.2832f);
+
+    for(int size : {4, 32, 256}){
+        for(size_t batchSize : {size_t(1000), size_t(10000)}){
+            std::vector<float> vertices;
+            std::vector<unsigned int> indices;
+            float half = size / 800.0f;
+            for(unsigned int i=0;i<batchSize/2;i++){
+                float x = center(rng), y = center(rng), a = angle(rng);
+                float ux = std::cos(a) * half, uy = std::sin(a) * half;
+                vertices.insert(vertices.end(), {x - ux + uy, y - uy - ux, 0.0f, x + ux + uy, y + uy - ux, 0.0f,
+                                                 x + ux - uy, y + uy + ux, 0.0f, x - ux - uy, y - uy + ux, 0.0f});
+                indices.insert(indices.end(), {4*i, 4*i + 1, 4*i + 2, 4*i, 4*i + 2, 4*i + 3});
+            }
+            std::ostringstream params;
+            params << "{\"size\": " << size << ", \"batch\": " << batchSize << "}";
+
+            Framebuffer fb(800, 800);
+            measure("fillTriangleEdgeFunctions", params.str(), batchSize, [&]{
+                size_t pixels = 0;
+                for(size_t i=0;i<indices.size();i+=3){
+                    const float* a = &vertices[indices[i] * 3];
+                    const float* b = &vertices[indices[i+1] * 3];
+                    const float* c = &vertices[indices[i+2] * 3];
+                    pixels += fillTriangleEdgeFunctions(fb, a[0], a[1], b[0], b[1], c[0], c[1], 0xffffffffu);
+                }
+                return pixels;
+            });
+            measure("fillMesh", params.str(), batchSize, [&]{
+                return fillMesh(fb, vertices.data(), indices.data(), indices.size(), 0xffffffffu);
+            });
+            RunBatch spans;
+            measure("scanlineBatch", params.str(), batchSize, [&]{
+                scanlineBatch(vertices.data(), indices.data(), indices.size(), 800, 800, spans);
+                return runPixels(spans);
+            });
+        }
+    }
+}
+
+// A dense scene of every primitive kind, drawn serially and by the tile renderer at growing
+// thread counts. The tile runs also report their slowest and mean tile and the steals.
+void tileBenchmarks(std::mt19937& rng){
+    std::uniform_int_distribution<int> coord(0, 799), offset(-100, 100), radius(2, 32), channel(0, 255);
+    std::uniform_real_distribution<float> ndc(-1.0f, 1.0f), size(-0.06f, 0.06f);
+
+    Scene scene;
+    for(int i=0;i<50000;i++){
+        uint32_t color = channel(rng) | channel(rng) << 8 | channel(rng) << 16 | 0xff000000u;
+        if(i % 5 < 3){
+            int x = coord(rng), y = coord(rng);
+            scene.addLine({x, y, x + offset(rng), y + offset(rng)}, color);
+        }
+        else if(i % 5 == 3){
+            scene.addCircle({coord(rng), coord(rng), radius(rng)}, color, i % 2 == 0);
+        }
+        else{
+            float x = ndc(rng), y = ndc(rng);
+            scene.addTriangle({{x, x + size(rng), x + size(rng)}, {y, y + size(rng), y + size(rng)}}, color);
+        }
+    }
+
+    std::string params = "{\"primitives\": " + std::to_string(scene.primitives.size()) + "}";
+    Framebuffer fb(800, 800);
+    measure("renderScene", params, scene.primitives.size(), [&]{
+        renderScene(scene, fb, rgba(0.0f, 0.0f, 0.0f));
+        return fb.pixels.size();
+    });
+
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned threads=1;;threads*=2){
+        threads = std::min(threads, hardware);
+        TileRenderer renderer(threads);
+        std::string tileParams = "{\"primitives\": " + std::to_string(scene.primitives.size()) +
+                                 ", \"threads\": " + std::to_string(threads) + "}";
+        measure("TileRenderer", tileParams, scene.primitives.size(), [&]{
+            renderer.render(scene, fb, rgba(0.0f, 0.0f, 0.0f));
+            return fb.pixels.size();
+        });
+
+        double slowest = 0.0, sum = 0.0, mean = 0.0;
+        for(const TileTiming& t : renderer.timings){
+            slowest = std::max(slowest, t.seconds);
+            sum += t.seconds;
+        }
+        if(!renderer.timings.empty()) mean = sum / renderer.timings.size();
+        std::ostringstream extra;
+        extra << ", \"tiles\": " << renderer.timings.size()
+              << ", \"slowest_tile_seconds\": " << slowest
+              << ", \"mean_tile_seconds\": " << mean
+              << ", \"steals\": " << renderer.pool.steals.load();
+        results.back().extra = extra.str();
+
+        if(threads == hardware) break;
+    }
+}
+
+void writeJson(std::ostream& out){
+    out << "{\n  \"results\": [\n";
+    for(size_t i=0;i<results.size();i++){
+        const Result& r = results[i];
+        out << "    {\"kernel\": \"" << r.kernel << "\", \"params\": " << r.params
+            << ", \"calls\": " << r.calls
+            << ", \"seconds_per_call\": " << r.secondsPerCall
+            << ", \"items_per_second\": " << r.itemsPerSecond
+            << ", \"pixels_per_second\": " << r.pixelsPerSecond
+            << ", \"allocations_per_call\": " << r.allocationsPerCall << r.extra << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv){
+    std::string outputPath;
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--quick") == 0) minSeconds = 0.005;
+        else if(std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) outputPath = argv[++i];
+    }
+
+    std::mt19937 rng(1);
+    lineBenchmarks(rng);
+    circleBenchmarks(rng);
+    transformBenchmarks(rng);
+    triangleBenchmarks(rng);
+    tileBenchmarks(rng);
+
+    if(outputPath.empty()){
+        writeJson(std::cout);
+    }
+    else{
+        std::ofstream file(outputPath);
+        writeJson(file);
+    }
+
+    return 0;
+}
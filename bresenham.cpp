@@ -5,9 +5,21 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "lines.h"
+#include "framebuffer.h"
+#include "thick.h"
+#include "wu.h"
+#include "compact.h"
+#include "scene.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
 // Shader sources
@@ -29,7 +41,183 @@ void main() {
 }
 )";
 
-int main(){
+// --aa: pixel coverage as alpha, blended over the background
+const char* coverageVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out float coverage;
+
+void main() {
+    gl_Position = vec4(aPos.xy, 0.0, 1.0);
+    coverage = aPos.z;
+}
+)";
+
+const char* coverageFragmentShaderSource = R"(
+#version 330 core
+in float coverage;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(0.0, 1.0, 0.0, coverage);
+}
+)";
+
+// Throughput of bresenhamBatch against the single segment push_back loop
+void benchmark(){
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> coord(0, 799);
+
+    std::vector<Segment> segments(200000);
+    for(auto& s : segments){
+        s = {coord(rng), coord(rng), coord(rng), coord(rng)};
+    }
+
+    auto seconds = [](auto start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<float> points;
+    for(auto& s : segments){
+        bresenhamLine(s.x1, s.y1, s.x2, s.y2, points);
+    }
+    double loopTime = seconds(start);
+    size_t pixels = points.size() / 3;
+
+    start = std::chrono::steady_clock::now();
+    LineBatch batch = bresenhamBatch(segments);
+    double batchTime = seconds(start);
+
+    // Wu writes two pixels per Bresenham pixel, compared per step along the line. Both write
+    // into warm buffers, the first bresenhamBatch above also paid for the page faults.
+    start = std::chrono::steady_clock::now();
+    bresenhamBatch(segments, batch);
+    double warmTime = seconds(start);
+
+    CoverageBatch coverage;
+    wuBatch<false>(segments, coverage);
+    start = std::chrono::steady_clock::now();
+    wuBatch<false>(segments, coverage);
+    double wuScalarTime = seconds(start);
+    start = std::chrono::steady_clock::now();
+    wuBatch(segments, coverage);
+    double wuTime = seconds(start);
+
+    std::cout << segments.size() << " segments, " << pixels << " pixels\n";
+    std::cout << "push_back loop: " << segments.size() / loopTime << " segments/s, "
+              << pixels / loopTime << " pixels/s\n";
+    std::cout << "bresenhamBatch: " << segments.size() / batchTime << " segments/s, "
+              << pixels / batchTime << " pixels/s (" << std::thread::hardware_concurrency() << " threads)\n";
+    std::cout << "outputs match: " << (batch.vertices == points ? "yes" : "no") << "\n";
+
+    // Same pixels as int16 pairs, a third of the bytes to write and upload
+    CompactLineBatch compactBatch;
+    bresenhamBatch(segments, compactBatch);
+    start = std::chrono::steady_clock::now();
+    bresenhamBatch(segments, compactBatch);
+    double compactTime = seconds(start);
+    std::cout << "bresenhamBatch compact: " << pixels / compactTime << " pixels/s, "
+              << sizeof(int16_t) * compactBatch.vertices.size() / 1048576.0 << " MiB against "
+              << sizeof(float) * batch.vertices.size() / 1048576.0 << " MiB, "
+              << compactTime / warmTime << "x the time\n";
+    std::cout << "wuBatch scalar: " << pixels / wuScalarTime << " steps/s, "
+              << wuScalarTime / warmTime << "x the bresenhamBatch time\n";
+    std::cout << "wuBatch " << wuLanes << " lanes: " << pixels / wuTime << " steps/s, "
+              << wuTime / warmTime << "x the bresenhamBatch time\n";
+
+    // Shallow lines (|slope| <= 1/16) are where run output pays off
+    std::uniform_int_distribution<int> rise(-40, 40);
+    for(auto& s : segments){
+        s.x1 = coord(rng) % 160;
+        s.x2 = 799 - coord(rng) % 160;
+        s.y2 = std::clamp(s.y1 + rise(rng), 0, 799);
+    }
+
+    start = std::chrono::steady_clock::now();
+    batch = bresenhamBatch(segments);
+    batchTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    RunBatch runs = bresenhamRunBatch(segments);
+    double runTime = seconds(start);
+
+    pixels = batch.vertices.size() / 3;
+    std::cout << "shallow lines, per pixel: " << pixels / batchTime << " pixels/s, "
+              << sizeof(float) * batch.vertices.size() / 1048576.0 << " MiB\n";
+    std::cout << "shallow lines, runs:      " << pixels / runTime << " pixels/s, "
+              << sizeof(Run) * runs.runs.size() / 1048576.0 << " MiB\n";
+
+    // Segments reaching far outside the window, most of their pixels would be thrown away
+    std::uniform_int_distribution<int> wide(-2400, 3200);
+    segments.resize(20000);
+    for(auto& s : segments){
+        s = {wide(rng), wide(rng), wide(rng), wide(rng)};
+    }
+
+    start = std::chrono::steady_clock::now();
+    bresenhamBatch(segments, batch);
+    double unclippedTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<WalkRange> ranges;
+    ClipStats stats = bresenhamClip(segments, {0, 0, 800, 800}, ranges);
+    double clipTime = seconds(start);
+    bresenhamBatch(segments, ranges, batch);
+    double clippedTime = seconds(start);
+
+    std::cout << "offscreen segments: " << stats.accepted << " inside, " << stats.trimmed << " trimmed, "
+              << stats.rejected << " rejected\n";
+    std::cout << "clipping avoided " << stats.pixelsAvoided() << " of " << stats.pixelsBefore << " pixels ("
+              << 100.0 * stats.pixelsAvoided() / stats.pixelsBefore << "%)\n";
+    std::cout << "unclipped: " << unclippedTime * 1000 << " ms, clip + rasterize: " << clippedTime * 1000
+              << " ms (clip " << clipTime * 1000 << " ms)\n";
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark();
+        return 0;
+    }
+    // --runs draws each run of pixels as one GL_LINES segment instead of a vertex per pixel
+    bool runMode = runsRequested(argc, argv);
+    // --aa draws anti-aliased lines with Xiaolin Wu's algorithm, coverage blended as alpha
+    bool antialias = antialiasRequested(argc, argv);
+    // --compact uploads the pixels as int16 window coordinates with the color as a uniform,
+    // a third of the vertex memory. --aa keeps its float coverage.
+    bool compact = compactRequested(argc, argv) && !antialias;
+
+    std::vector<Segment> segments = {
+        {100, 100, 700, 700}
+    };
+    // --scene file.scene draws the lines of a scene file instead, read in place from the mapping
+    ArrayView<Segment> drawnSegments = segments;
+    MappedScene scene;
+    std::string scenePath;
+    if(sceneRequested(argc, argv, scenePath)){
+        if(!scene.open(scenePath)){
+            std::cerr << scenePath << ": " << scene.error << "\n";
+            return -1;
+        }
+        drawnSegments = scene.view.segments;
+    }
+    // --thick [width] draws every segment as a quad that many pixels wide
+    float thickWidth = 2.0f;
+    bool thick = thickRequested(argc, argv, thickWidth);
+
+    // --headless [image.ppm|image.png] rasterizes the runs into a software framebuffer
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            if(thick) return drawThickSegments(fb, drawnSegments, thickWidth, rgba(0.0f, 1.0f, 0.0f));
+            if(antialias) return drawSegmentsAntialiased(fb, drawnSegments, rgba(0.0f, 1.0f, 0.0f));
+            return drawSegments(fb, drawnSegments, rgba(0.0f, 1.0f, 0.0f));
+        });
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
@@ -50,40 +238,44 @@ int main(){
 
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    
-    std::vector<float> points;
-
-    int x1, x2, y1, y2;
 
-    x1 = 100, y1 = 100;
-    x2 = 700, y2 = 700;
-
-    int dx = std::abs(x2 - x1);
-    int dy = std::abs(y2 - y1);
-
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-
-    int err = dx - dy;
-
-    while(true){
-        points.push_back(x1 / 400.0f - 1.0f);
-        points.push_back(y1 / 400.0f - 1.0f);
-        points.push_back(0.0f);
-
-        if (x1 == x2 && y1 == y2) break;
+    // The one time setup is timed as frame 0: generating the pixels and uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+
+    ThickLines lines;
+    if(thick){
+        timer.beginCpu("upload");
+        lines.create();
+        lines.upload(drawnSegments, thickWidth);
+        timer.endCpu("upload");
+    }
 
-        int e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x1 += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y1 += sy;
-        }
+    timer.beginCpu("generate");
+    LineBatch batch;
+    CompactLineBatch compactBatch;
+    if(runMode){
+        RunBatch runs = bresenhamRunBatch(drawnSegments);
+        if(compact) compactBatch.vertices = runsToLines<int16_t>(runs.runs);
+        else batch.vertices = runsToLines(runs.runs);
+    }
+    else if(antialias){
+        CoverageBatch coverage;
+        wuBatch(drawnSegments, coverage);
+        batch.vertices = coverageToPoints(coverage);
     }
+    else{
+        // Only the part of each segment inside the window is rasterized
+        std::vector<WalkRange> ranges;
+        bresenhamClip(drawnSegments, {0, 0, 800, 800}, ranges);
+        if(compact) bresenhamBatch(drawnSegments, ranges, compactBatch);
+        else bresenhamBatch(drawnSegments, ranges, batch);
+    }
+    timer.endCpu("generate");
+    if(compact) reportVertexMemory(compactBatch);
 
+    timer.beginCpu("upload");
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -91,20 +283,29 @@ int main(){
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(points), points.data(), GL_STATIC_DRAW);
+    if(compact){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t)*compactBatch.vertices.size(), compactBatch.vertices.data(), GL_STATIC_DRAW);
+        compactVertexAttrib();
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*batch.vertices.size(), batch.vertices.data(), GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
 
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, compact ? &compactVertexShaderSource
+                                    : antialias ? &coverageVertexShaderSource : &vertexShaderSource, NULL);
     glCompileShader(vertexShader);
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, compact ? &compactFragmentShaderSource
+                                      : antialias ? &coverageFragmentShaderSource : &fragmentShaderSource, NULL);
     glCompileShader(fragmentShader);
 
     unsigned int shaderProgram = glCreateProgram();
@@ -115,7 +316,18 @@ int main(){
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    while(!glfwWindowShouldClose(window)){
+    if(compact){
+        glUseProgram(shaderProgram);
+        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 0.0f, 1.0f, 0.0f);
+    }
+
+    timer.endFrame();
+
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -123,12 +335,35 @@ int main(){
         glUseProgram(shaderProgram);
 
         glLineWidth(2.0f);
-        glDrawArrays(GL_LINE_STRIP, 0, points.size()/3);
+        if(thick){
+            lines.draw(0.0f, 1.0f, 0.0f);
+        }
+        else if(antialias){
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDrawArrays(GL_POINTS, 0, batch.vertices.size()/3);
+        }
+        else if(runMode){
+            glDrawArrays(GL_LINES, 0, compact ? compactBatch.vertexCount() : batch.vertexCount());
+        }
+        else if(compact){
+            glMultiDrawArrays(GL_LINE_STRIP, compactBatch.first.data(), compactBatch.count.data(), drawnSegments.size());
+        }
+        else{
+            glMultiDrawArrays(GL_LINE_STRIP, batch.first.data(), batch.count.data(), drawnSegments.size());
+        }
 
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
+    if(thick) lines.destroy();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwDestroyWindow(window);
@@ -4,44 +4,19 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <vector>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include "circle.h"
+#include "framebuffer.h"
+#include "compact.h"
+#include "scene.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
-}
-
-std::vector<float> midpointCircle(int xc, int yc, int r){
-    std::vector<float> points;
-    
-    int x = 0, y = r;
-    int p = 1 - r;
-
-    while(x <= y){
-        float px = xc / 400.0f - 1.0f;
-        float py = yc / 400.0f - 1.0f;
-
-        //eight point symmetry around center
-        points.insert(points.end(), {
-            (xc + x) / 400.0f - 1.0f, (yc + y) / 400.0f - 1.0f, 0.0f,
-            (xc - x) / 400.0f - 1.0f, (yc + y) / 400.0f - 1.0f, 0.0f,
-            (xc + x) / 400.0f - 1.0f, (yc - y) / 400.0f - 1.0f, 0.0f,
-            (xc - x) / 400.0f - 1.0f, (yc - y) / 400.0f - 1.0f, 0.0f,
-            (xc + y) / 400.0f - 1.0f, (yc + x) / 400.0f - 1.0f, 0.0f,
-            (xc - y) / 400.0f - 1.0f, (yc + x) / 400.0f - 1.0f, 0.0f,
-            (xc + y) / 400.0f - 1.0f, (yc - x) / 400.0f - 1.0f, 0.0f,
-            (xc - y) / 400.0f - 1.0f, (yc - x) / 400.0f - 1.0f, 0.0f
-        });
-
-        x++;
-        if(p<0){
-            p += 2*x+1;
-        }
-        else{
-            y--;
-            p += 2*(x-y)+1;
-        }
-    }
-
-    return points;
+    requestRedraw(window);
 }
 
 // Shader sources
@@ -63,7 +38,88 @@ void main() {
 }
 )";
 
-int main(){
+// Batched contours against batched filled spans for many circles
+void benchmark(){
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> coord(100, 699), radius(1, 100);
+
+    std::vector<Circle> circles(20000);
+    for(auto& c : circles){
+        c = {coord(rng), coord(rng), radius(rng)};
+    }
+
+    auto bestTime = [](auto generate){
+        double best = 1e30;
+        for(int run=0;run<4;run++){
+            auto start = std::chrono::steady_clock::now();
+            generate();
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(run > 0) best = std::min(best, t);
+        }
+        return best;
+    };
+
+    LineBatch outlines;
+    RunBatch spans;
+    double outlineTime = bestTime([&]{ circleBatch(circles, outlines); });
+    double spanTime = bestTime([&]{ circleSpanBatch(circles, spans); });
+
+    size_t filled = 0;
+    for(const Run& r : spans.runs) filled += r.length;
+
+    std::cout << circles.size() << " circles\n";
+    std::cout << "contours: " << circles.size() / outlineTime << " circles/s, "
+              << outlines.vertices.size() / 3 / outlineTime << " points/s\n";
+    CompactLineBatch compact;
+    double compactTime = bestTime([&]{ circleBatch(circles, compact); });
+    std::cout << "compact:  " << circles.size() / compactTime << " circles/s, "
+              << sizeof(int16_t) * compact.vertices.size() / 1048576.0 << " MiB against "
+              << sizeof(float) * outlines.vertices.size() / 1048576.0 << " MiB\n";
+    std::cout << "filled:   " << circles.size() / spanTime << " circles/s, "
+              << filled / spanTime << " pixels/s as " << spans.runs.size() << " spans\n";
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark();
+        return 0;
+    }
+    // --filled draws the disc as one GL_LINES span per scanline
+    bool filled = filledRequested(argc, argv);
+    // --compact uploads the points as int16 window coordinates with the color as a uniform,
+    // a third of the vertex memory
+    bool compact = compactRequested(argc, argv);
+
+    std::vector<Circle> circles = {
+        {200, 200, 100}
+    };
+    // --scene file.scene draws the circles of a scene file instead, read in place from the mapping
+    ArrayView<Circle> drawnCircles = circles;
+    MappedScene scene;
+    std::string scenePath;
+    if(sceneRequested(argc, argv, scenePath)){
+        if(!scene.open(scenePath)){
+            std::cerr << scenePath << ": " << scene.error << "\n";
+            return -1;
+        }
+        drawnCircles = scene.view.circles;
+    }
+
+    // --headless [image.ppm|image.png] rasterizes the circle into a software framebuffer
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            size_t pixels = 0;
+            for(const Circle& circle : drawnCircles){
+                if(filled) pixels += fillCircle(fb, circle, rgba(1.0f, 1.0f, 1.0f));
+                else pixels += drawCircle(fb, circle, rgba(1.0f, 1.0f, 1.0f));
+            }
+            return pixels;
+        });
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
@@ -85,8 +141,30 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    std::vector<float> circlePoints = midpointCircle(200, 200, 100);
+    // The one time setup is timed as frame 0: generating the points and uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+
+    // One GL_LINE_LOOP contour per circle, or every span of every disc as GL_LINES
+    timer.beginCpu("generate");
+    LineBatch outlines;
+    CompactLineBatch compactOutlines;
+    if(filled){
+        RunBatch spans;
+        circleSpanBatch(drawnCircles, spans);
+        if(compact) compactOutlines.vertices = runsToLines<int16_t>(spans.runs);
+        else outlines.vertices = runsToLines(spans.runs);
+    }
+    else{
+        if(compact) circleBatch(drawnCircles, compactOutlines);
+        else circleBatch(drawnCircles, outlines);
+    }
+    timer.endCpu("generate");
+    if(compact) reportVertexMemory(compactOutlines);
+    int pointCount = compact ? compactOutlines.vertexCount() : outlines.vertexCount();
 
+    timer.beginCpu("upload");
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -94,20 +172,27 @@ int main(){
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*circlePoints.size(), circlePoints.data(), GL_STATIC_DRAW);
+    if(compact){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t)*compactOutlines.vertices.size(), compactOutlines.vertices.data(), GL_STATIC_DRAW);
+        compactVertexAttrib();
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*outlines.vertices.size(), outlines.vertices.data(), GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
 
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, compact ? &compactVertexShaderSource : &vertexShaderSource, NULL);
     glCompileShader(vertexShader);
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, compact ? &compactFragmentShaderSource : &fragmentShaderSource, NULL);
     glCompileShader(fragmentShader);
 
     unsigned int shaderProgram = glCreateProgram();
@@ -118,7 +203,18 @@ int main(){
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    while(!glfwWindowShouldClose(window)){
+    if(compact){
+        glUseProgram(shaderProgram);
+        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 1.0f, 1.0f);
+    }
+
+    timer.endFrame();
+
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -126,11 +222,25 @@ int main(){
         glUseProgram(shaderProgram);
 
         glLineWidth(2.0f);
-        glDrawArrays(GL_LINE_STRIP, 0, circlePoints.size()/3);
+        if(filled){
+            glDrawArrays(GL_LINES, 0, pointCount);
+        }
+        else if(compact){
+            glMultiDrawArrays(GL_LINE_LOOP, compactOutlines.first.data(), compactOutlines.count.data(), drawnCircles.size());
+        }
+        else{
+            glMultiDrawArrays(GL_LINE_LOOP, outlines.first.data(), outlines.count.data(), drawnCircles.size());
+        }
 
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
@@ -0,0 +1,277 @@
+//Midpoint circle kernels shared by the circle programs
+//Coordinates are in pixels of the 800x800 window, output vertices are NDC (x, y, 0) or, in
+//the compact format of lines.h, int16 window pixels
+
+#pragma once
+
+#include "lines.h"
+#include <cmath>
+#include <cstring>
+
+struct Circle{
+    int xc, yc, r;
+};
+
+// One step of the octant walk every midpoint kernel shares, starting from x = 0, y = r and
+// p = 1 - r: x moves on, and y drops when the midpoint between the two candidate rows is
+// outside the circle
+inline void midpointStep(int& x, int& y, int& p){
+    x++;
+    if(p<0){
+        p += 2*x+1;
+    }
+    else{
+        y--;
+        p += 2*(x-y)+1;
+    }
+}
+
+// Number of steps of the octant walk, each step emits the eight symmetric points. The walk
+// goes on while x <= y, and the y it picks for an x is at least x exactly when (x, x) passes
+// the midpoint test x^2 + y^2 - y < r^2, so there is one step more than the largest x with
+// 2x^2 - x < r^2. The square root gives that x up to rounding, which the loops correct.
+inline int midpointSteps(int r){
+    if(r <= 0) return r == 0 ? 1 : 0;
+
+    long long rr = (long long)r * r;
+    long long x = (long long)((1.0 + std::sqrt(1.0 + 8.0 * (double)rr)) / 4.0);
+    while(2 * x * x - x >= rr) x--;
+    while(2 * (x + 1) * (x + 1) - (x + 1) < rr) x++;
+    return (int)x + 1;
+}
+
+template<typename T>
+inline T* midpointCircle(int xc, int yc, int r, T* out){
+    PROFILE_ZONE(zone, "midpointCircle");
+    T* start = out;
+    int x = 0, y = r;
+    int p = 1 - r;
+
+    while(x <= y){
+        //eight point symmetry around center
+        out = putVertex(out, xc + x, yc + y);
+        out = putVertex(out, xc - x, yc + y);
+        out = putVertex(out, xc + x, yc - y);
+        out = putVertex(out, xc - x, yc - y);
+        out = putVertex(out, xc + y, yc + x);
+        out = putVertex(out, xc - y, yc + x);
+        out = putVertex(out, xc + y, yc - x);
+        out = putVertex(out, xc - y, yc - x);
+
+        midpointStep(x, y, p);
+    }
+
+    zone.pixels((out - start) / VertexBatch<T>::components);
+    return out;
+}
+
+inline std::vector<float> midpointCircle(int xc, int yc, int r){
+    std::vector<float> points(midpointSteps(r) * 24);
+    midpointCircle(xc, yc, r, points.data());
+    return points;
+}
+
+// Contour output: the same pixels as midpointCircle in counter-clockwise order starting at
+// (xc + r, yc), each pixel once, so it can be drawn as a GL_LINE_LOOP. midpointCircle
+// interleaves the octants, which as a GL_LINE_STRIP draws chords across the circle, and
+// repeats the points where x == 0 and x == y.
+
+// Whether the octant walk of r > 0 ends on the diagonal. Its last step has x = steps - 1 and
+// y either x or x + 1; it is x + 1 when that point passes the midpoint test
+// x^2 + y^2 - y < r^2, otherwise the walk ends on x == y.
+inline bool midpointEndsOnDiagonal(int r, long long steps){
+    return !((steps - 1) * (steps - 1) + steps * steps - steps < (long long)r * r);
+}
+
+// Number of contour points, 8 per step minus the shared x == 0 and x == y points
+inline int midpointContourCount(int r){
+    if(r == 0) return 1;
+
+    long long steps = midpointSteps(r);
+    return (int)(8 * steps - 4 - (midpointEndsOnDiagonal(r, steps) ? 4 : 0));
+}
+
+// One octant walk writing all eight octants, each through its own pointer with its signs
+// and swap fixed. Counter-clockwise from (xc + r, yc) the octants alternate between running
+// with the walk, filled from their start, and against it, filled from their end. An
+// octant against the walk leaves out x == 0, which the next octant starts on, and x == y when
+// the walk ends there, which the previous octant ends on; those steps are taken apart from
+// the loop so it writes every point once without checking.
+template<typename T>
+inline T* midpointContour(int xc, int yc, int r, T* out){
+    PROFILE_ZONE(zone, "midpointContour");
+    if(r == 0){
+        zone.pixels(1);
+        return putVertex(out, xc, yc);
+    }
+
+    const int components = VertexBatch<T>::components;
+    int steps = midpointSteps(r);
+    bool diagonal = midpointEndsOnDiagonal(r, steps);
+    int backward = diagonal ? steps - 2 : steps - 1;
+    int octant = steps + backward;
+
+    T* o0 = out;
+    T* o2 = out + (size_t)octant * components;
+    T* o4 = out + (size_t)2 * octant * components;
+    T* o6 = out + (size_t)3 * octant * components;
+    T* o1 = o2;
+    T* o3 = o4;
+    T* o5 = o6;
+    T* o7 = out + (size_t)4 * octant * components;
+
+    int x = 0, y = r;
+    int p = 1 - r;
+    auto forward = [&]{
+        o0 = putVertex(o0, xc + y, yc + x);
+        o2 = putVertex(o2, xc - x, yc + y);
+        o4 = putVertex(o4, xc - y, yc - x);
+        o6 = putVertex(o6, xc + x, yc - y);
+    };
+
+    forward();
+    midpointStep(x, y, p);
+    // Writing the octants against the walk one point at a time runs four stores downwards,
+    // which costs about a quarter of the float batch; keep a chunk of the walk and write
+    // its piece of each of those octants upwards instead
+    const int chunk = 64;
+    int xs[chunk], ys[chunk];
+    for(int k=1;k<=backward;k+=chunk){
+        int n = std::min(chunk, backward - k + 1);
+        for(int j=0;j<n;j++){
+            forward();
+            xs[j] = x;
+            ys[j] = y;
+            midpointStep(x, y, p);
+        }
+        o1 -= (size_t)n * components;
+        o3 -= (size_t)n * components;
+        o5 -= (size_t)n * components;
+        o7 -= (size_t)n * components;
+        T* w1 = o1;
+        T* w3 = o3;
+        T* w5 = o5;
+        T* w7 = o7;
+        for(int j=n-1;j>=0;j--){
+            w1 = putVertex(w1, xc + xs[j], yc + ys[j]);
+            w3 = putVertex(w3, xc - ys[j], yc + xs[j]);
+            w5 = putVertex(w5, xc - xs[j], yc - ys[j]);
+            w7 = putVertex(w7, xc + ys[j], yc - xs[j]);
+        }
+    }
+    if(diagonal){
+        forward();
+    }
+
+    zone.pixels(4 * octant);
+    return out + (size_t)4 * octant * components;
+}
+
+template<typename T = float>
+inline std::vector<T> midpointContour(int xc, int yc, int r){
+    std::vector<T> points(midpointContourCount(r) * VertexBatch<T>::components);
+    midpointContour(xc, yc, r, points.data());
+    return points;
+}
+
+// A filled disc has one span per scanline, 2r + 1 in total
+inline int circleSpanCount(int r){
+    return 2 * r + 1;
+}
+
+// Filled disc as horizontal spans, one per scanline, walking the same octant as
+// midpointCircle. Rows yc +- x get their span on every step; rows yc +- y only once
+// y is about to change, when x has reached the widest point of that row.
+inline Run* midpointCircleSpans(int xc, int yc, int r, Run* out){
+    PROFILE_ZONE(zone, "midpointCircleSpans");
+    Run* start = out;
+    int x = 0, y = r;
+    int p = 1 - r;
+
+    while(x <= y){
+        *out++ = {xc - y, yc + x, 2 * y + 1, 0};
+        if(x != 0){
+            *out++ = {xc - y, yc - x, 2 * y + 1, 0};
+        }
+
+        int row = y;
+        midpointStep(x, y, p);
+        // Row yc +- row was already written as a row yc +- x when x caught up with it
+        if(y != row && row >= x){
+            *out++ = {xc - x + 1, yc + row, 2 * x - 1, 0};
+            *out++ = {xc - x + 1, yc - row, 2 * x - 1, 0};
+        }
+    }
+
+    size_t pixels = 0;
+    for(Run* s=start;s!=out;s++) pixels += s->length;
+    zone.pixels(pixels);
+    return out;
+}
+
+inline std::vector<Run> midpointCircleSpans(int xc, int yc, int r){
+    std::vector<Run> spans(circleSpanCount(r));
+    midpointCircleSpans(xc, yc, r, spans.data());
+    return spans;
+}
+
+// Contours of many circles in one buffer laid out like a LineBatch, drawn with
+// glMultiDrawArrays(GL_LINE_LOOP). Sized up front and filled in parallel with each thread
+// writing only its own circles.
+template<typename T>
+inline void circleBatch(ArrayView<Circle> circles, VertexBatch<T>& batch, unsigned threads = 0){
+    PROFILE_ZONE(zone, "circleBatch");
+    size_t capacity = batch.vertices.capacity();
+    size_t n = circles.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = midpointContourCount(circles[i].r);
+        total += batch.count[i];
+    }
+    batch.vertices.resize(total * batch.components);
+    zone.bytes(grownBytes(batch.vertices, capacity));
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            const Circle& c = circles[i];
+            midpointContour(c.xc, c.yc, c.r, batch.vertices.data() + (size_t)batch.first[i] * batch.components);
+        }
+    });
+}
+
+// Filled discs of many circles as spans, 2r + 1 per circle
+inline void circleSpanBatch(ArrayView<Circle> circles, RunBatch& batch, unsigned threads = 0){
+    PROFILE_ZONE(zone, "circleSpanBatch");
+    size_t capacity = batch.runs.capacity();
+    size_t n = circles.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = circleSpanCount(circles[i].r);
+        total += batch.count[i];
+    }
+    batch.runs.resize(total);
+    zone.bytes(grownBytes(batch.runs, capacity));
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            const Circle& c = circles[i];
+            midpointCircleSpans(c.xc, c.yc, c.r, batch.runs.data() + batch.first[i]);
+        }
+    });
+}
+
+// --filled anywhere on the command line
+inline bool filledRequested(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--filled") == 0) return true;
+    }
+    return false;
+}
@@ -0,0 +1,343 @@
+//Clipping stages ahead of rasterization
+//Lines: outcodes for whole batches of segments, then each one is trivially accepted, trivially
+//rejected or trimmed to the pixels of its walk that land in the viewport
+//Polygons: Sutherland-Hodgman against a box in NDC, results packed into one arena
+
+#pragma once
+
+#include "lines.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Pixels [x0, x1) x [y0, y1)
+struct Rect{
+    int x0, y0, x1, y1;
+};
+
+// Cohen-Sutherland outcode bits
+enum Outcode{
+    outLeft = 1,
+    outBelow = 2,
+    outRight = 4,
+    outAbove = 8
+};
+
+inline int outcode(int x, int y, const Rect& r){
+    return (x < r.x0 ? outLeft : 0) | (y < r.y0 ? outBelow : 0) |
+           (x >= r.x1 ? outRight : 0) | (y >= r.y1 ? outAbove : 0);
+}
+
+// Both outcodes of a segment in one byte, start point in the low nibble
+inline uint8_t segmentOutcodes(const Segment& s, const Rect& r){
+    return (uint8_t)(outcode(s.x1, s.y1, r) | outcode(s.x2, s.y2, r) << 4);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// A Segment is (x1, y1, x2, y2) in 16 bytes, compared against (x0, y0, x0, y0) and
+// (x1 - 1, y1 - 1, x1 - 1, y1 - 1) of the rect. The sign masks of the two compares hold the
+// left/below and right/above bits of both end points, the nibbles of segmentOutcodes.
+inline uint8_t outcodeNibbles(int outside, int beyond){
+    return (uint8_t)((outside & 3) | (beyond & 3) << 2 | (outside & 12) << 2 | (beyond & 12) << 4);
+}
+#endif
+
+// segmentOutcodes of every segment into codes
+inline void batchOutcodes(ArrayView<Segment> segments, const Rect& r, std::vector<uint8_t>& codes){
+    static_assert(sizeof(Segment) == 4 * sizeof(int), "segments are loaded as four ints");
+    size_t n = segments.size();
+    codes.resize(n);
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    // Two segments per load
+    __m256i lo = _mm256_setr_epi32(r.x0, r.y0, r.x0, r.y0, r.x0, r.y0, r.x0, r.y0);
+    __m256i hi = _mm256_setr_epi32(r.x1 - 1, r.y1 - 1, r.x1 - 1, r.y1 - 1, r.x1 - 1, r.y1 - 1, r.x1 - 1, r.y1 - 1);
+    for(;i+2<=n;i+=2){
+        __m256i v = _mm256_loadu_si256((const __m256i*)&segments[i]);
+        int outside = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lo, v)));
+        int beyond = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, hi)));
+        codes[i] = outcodeNibbles(outside, beyond);
+        codes[i+1] = outcodeNibbles(outside >> 4, beyond >> 4);
+    }
+#elif defined(__SSE2__)
+    __m128i lo = _mm_setr_epi32(r.x0, r.y0, r.x0, r.y0);
+    __m128i hi = _mm_setr_epi32(r.x1 - 1, r.y1 - 1, r.x1 - 1, r.y1 - 1);
+    for(;i<n;i++){
+        __m128i v = _mm_loadu_si128((const __m128i*)&segments[i]);
+        int outside = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, lo)));
+        int beyond = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, hi)));
+        codes[i] = outcodeNibbles(outside, beyond);
+    }
+#endif
+
+    for(;i<n;i++) codes[i] = segmentOutcodes(segments[i], r);
+}
+
+// Walk pixels of a Bresenham segment inside r, as in Liang-Barsky but on the integer walk
+// instead of the ideal line: the major axis bounds the pixel index directly and the minor
+// axis bounds the number of minor steps, turned into pixel indices by the closed form of the
+// error term. The pixels in the range are exactly the pixels of the whole walk inside r.
+inline WalkRange bresenhamClipRange(const Segment& s, const Rect& r){
+    int dx = std::abs(s.x2 - s.x1);
+    int dy = std::abs(s.y2 - s.y1);
+    bool xMajor = dx >= dy;
+    int dMajor = xMajor ? dx : dy;
+    int dMinor = xMajor ? dy : dx;
+    int majorStep = xMajor ? (s.x1 <= s.x2 ? 1 : -1) : (s.y1 <= s.y2 ? 1 : -1);
+    int minorStep = xMajor ? (s.y1 <= s.y2 ? 1 : -1) : (s.x1 <= s.x2 ? 1 : -1);
+    int a1 = xMajor ? s.x1 : s.y1, b1 = xMajor ? s.y1 : s.x1;
+
+    int aLo = xMajor ? r.x0 : r.y0, aHi = (xMajor ? r.x1 : r.y1) - 1;
+    int bLo = xMajor ? r.y0 : r.x0, bHi = (xMajor ? r.y1 : r.x1) - 1;
+    long long i0 = majorStep > 0 ? aLo - a1 : a1 - aHi, i1 = majorStep > 0 ? aHi - a1 : a1 - aLo;
+    long long m0 = minorStep > 0 ? bLo - b1 : b1 - bHi, m1 = minorStep > 0 ? bHi - b1 : b1 - bLo;
+    i0 = std::max(i0, 0LL);
+    i1 = std::min(i1, (long long)dMajor);
+    m0 = std::max(m0, 0LL);
+    m1 = std::min(m1, (long long)dMinor);
+    if(m0 > m1) return {0, 0};
+    if(dMinor > 0){
+        i0 = std::max(i0, bresenhamFirstPixel(m0, dMajor, dMinor));
+        i1 = std::min(i1, bresenhamFirstPixel(m1 + 1, dMajor, dMinor) - 1);
+    }
+    if(i0 > i1) return {0, 0};
+    return {(int)i0, (int)i1 + 1};
+}
+
+inline long long floorDiv(long long a, long long b){
+    long long q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+inline long long ceilDiv(long long a, long long b){
+    return -floorDiv(-a, b);
+}
+
+// Indices i in [i0, i1] with lo <= (acc + i * inc) >> 16 <= hi, narrowing the range in place
+inline void ddaClipAxis(int acc, int inc, int lo, int hi, long long& i0, long long& i1){
+    long long low = (long long)lo * 65536 - acc, high = (long long)hi * 65536 + 65535 - acc;
+    if(inc == 0){
+        if(low > 0 || high < 0) i1 = i0 - 1;
+        return;
+    }
+    if(inc > 0){
+        i0 = std::max(i0, ceilDiv(low, inc));
+        i1 = std::min(i1, floorDiv(high, inc));
+    }
+    else{
+        i0 = std::max(i0, ceilDiv(high, inc));
+        i1 = std::min(i1, floorDiv(low, inc));
+    }
+}
+
+// Walk pixels of a DDA segment inside r. Each coordinate of pixel i is an affine function of
+// i shifted down by 16, so each axis bounds i by one division per side.
+inline WalkRange ddaClipRange(const Segment& s, const Rect& r){
+    int accX, accY, incX, incY;
+    ddaSetup(s, accX, accY, incX, incY);
+    long long i0 = 0, i1 = bresenhamPixelCount(s) - 1;
+    ddaClipAxis(accX, incX, r.x0, r.x1 - 1, i0, i1);
+    ddaClipAxis(accY, incY, r.y0, r.y1 - 1, i0, i1);
+    if(i0 > i1) return {0, 0};
+    return {(int)i0, (int)i1 + 1};
+}
+
+// Rasterization work before and after clipping a batch
+struct ClipStats{
+    size_t accepted = 0, rejected = 0, trimmed = 0;
+    size_t pixelsBefore = 0, pixelsAfter = 0;
+
+    size_t pixelsAvoided() const{
+        return pixelsBefore - pixelsAfter;
+    }
+};
+
+// Fills ranges with the walk range of every segment inside viewport. Both end points inside
+// keeps the whole walk, both outside on the same side drops it without looking further (a
+// walk never leaves the bounding box of its end points), and only the rest pay for
+// clipRange. Rejected segments get an empty range and draw nothing.
+template<typename ClipRange>
+inline ClipStats clipSegments(ArrayView<Segment> segments, const Rect& viewport,
+                              std::vector<WalkRange>& ranges, ClipRange clipRange){
+    std::vector<uint8_t> codes;
+    batchOutcodes(segments, viewport, codes);
+    ranges.resize(segments.size());
+
+    ClipStats stats;
+    for(size_t i=0;i<segments.size();i++){
+        int count = bresenhamPixelCount(segments[i]);
+        int start = codes[i] & 15, end = codes[i] >> 4;
+        stats.pixelsBefore += count;
+
+        if((start | end) == 0){
+            ranges[i] = {0, count};
+            stats.accepted++;
+        }
+        else if(start & end){
+            ranges[i] = {0, 0};
+            stats.rejected++;
+        }
+        else{
+            ranges[i] = clipRange(segments[i], viewport);
+            if(ranges[i].end > ranges[i].begin) stats.trimmed++;
+            else stats.rejected++;
+        }
+        stats.pixelsAfter += ranges[i].end - ranges[i].begin;
+    }
+    return stats;
+}
+
+inline ClipStats bresenhamClip(ArrayView<Segment> segments, const Rect& viewport, std::vector<WalkRange>& ranges){
+    return clipSegments(segments, viewport, ranges, bresenhamClipRange);
+}
+
+inline ClipStats ddaClip(ArrayView<Segment> segments, const Rect& viewport, std::vector<WalkRange>& ranges){
+    return clipSegments(segments, viewport, ranges, ddaClipRange);
+}
+
+// Box in NDC, x0 <= x <= x1 and y0 <= y <= y1
+struct ClipBox{
+    float x0, y0, x1, y1;
+};
+
+const ClipBox ndcBox = {-1.0f, -1.0f, 1.0f, 1.0f};
+
+inline int outcode(float x, float y, const ClipBox& b){
+    return (x < b.x0 ? outLeft : 0) | (y < b.y0 ? outBelow : 0) |
+           (x > b.x1 ? outRight : 0) | (y > b.y1 ? outAbove : 0);
+}
+
+// Clipped polygons of different lengths in one buffer: polygon i is the points
+// [first[i], first[i] + count[i]) of x and y, count 0 when nothing of it was left. Cleared
+// and refilled every frame, so after the first frame clipping allocates nothing.
+struct PolygonArena{
+    std::vector<float> x, y;
+    std::vector<int> first, count;
+    // Ping-pong buffers for the passes of Sutherland-Hodgman
+    std::vector<float> scratchX[2], scratchY[2];
+
+    void clear(){
+        x.clear();
+        y.clear();
+        first.clear();
+        count.clear();
+    }
+
+    size_t size() const{
+        return first.size();
+    }
+};
+
+// Polygons kept whole, dropped and cut, and the vertices going in and coming out
+struct PolygonClipStats{
+    size_t accepted = 0, rejected = 0, clipped = 0;
+    size_t verticesBefore = 0, verticesAfter = 0;
+};
+
+// One Sutherland-Hodgman pass, keeping the side of the line coordinate == bound given by
+// keep. The crossing is always computed from the inside end point, so an edge shared by two
+// polygons is cut at the same point from both sides and no cracks open between them.
+template<typename Keep>
+inline int clipPass(const float* px, const float* py, int n, bool vertical, float bound, Keep keep,
+                    std::vector<float>& outX, std::vector<float>& outY){
+    outX.clear();
+    outY.clear();
+    for(int i=0;i<n;i++){
+        int j = (i + 1 == n) ? 0 : i + 1;
+        float a = vertical ? px[i] : py[i], b = vertical ? px[j] : py[j];
+        bool inA = keep(a), inB = keep(b);
+        if(inA){
+            outX.push_back(px[i]);
+            outY.push_back(py[i]);
+        }
+        if(inA != inB){
+            int from = inA ? i : j, to = inA ? j : i;
+            float fromV = inA ? a : b, toV = inA ? b : a;
+            float t = (bound - fromV) / (toV - fromV);
+            if(vertical){
+                outX.push_back(bound);
+                outY.push_back(py[from] + t * (py[to] - py[from]));
+            }
+            else{
+                outX.push_back(px[from] + t * (px[to] - px[from]));
+                outY.push_back(bound);
+            }
+        }
+    }
+    return (int)outX.size();
+}
+
+// Appends polygon (px[i], py[i]), n vertices, clipped to box as the next polygon of arena and
+// returns its vertex count. Convex polygons stay convex.
+inline int clipPolygon(const float* px, const float* py, int n, const ClipBox& box, PolygonArena& arena,
+                       PolygonClipStats& stats){
+    arena.first.push_back((int)arena.x.size());
+    stats.verticesBefore += n;
+
+    int all = 0, common = ~0;
+    for(int i=0;i<n;i++){
+        int code = outcode(px[i], py[i], box);
+        all |= code;
+        common &= code;
+    }
+    if(n < 3 || common != 0){
+        arena.count.push_back(0);
+        stats.rejected++;
+        return 0;
+    }
+    if(all == 0){
+        arena.x.insert(arena.x.end(), px, px + n);
+        arena.y.insert(arena.y.end(), py, py + n);
+        arena.count.push_back(n);
+        stats.accepted++;
+        stats.verticesAfter += n;
+        return n;
+    }
+
+    // Only the sides some vertex is outside of need a pass
+    const float* cx = px;
+    const float* cy = py;
+    int m = n, buffer = 0;
+    auto pass = [&](int bit, bool vertical, float bound, auto keep){
+        if(!(all & bit) || m == 0) return;
+        m = clipPass(cx, cy, m, vertical, bound, keep, arena.scratchX[buffer], arena.scratchY[buffer]);
+        cx = arena.scratchX[buffer].data();
+        cy = arena.scratchY[buffer].data();
+        buffer ^= 1;
+    };
+    pass(outLeft, true, box.x0, [&](float v){ return v >= box.x0; });
+    pass(outRight, true, box.x1, [&](float v){ return v <= box.x1; });
+    pass(outBelow, false, box.y0, [&](float v){ return v >= box.y0; });
+    pass(outAbove, false, box.y1, [&](float v){ return v <= box.y1; });
+
+    // Straddling a corner can still leave nothing
+    if(m < 3) m = 0;
+    arena.x.insert(arena.x.end(), cx, cx + m);
+    arena.y.insert(arena.y.end(), cy, cy + m);
+    arena.count.push_back(m);
+    if(m > 0) stats.clipped++;
+    else stats.rejected++;
+    stats.verticesAfter += m;
+    return m;
+}
+
+// Number of GL_TRIANGLES vertices after fanning every polygon of arena
+inline size_t fanVertexCount(const PolygonArena& arena){
+    size_t n = 0;
+    for(int c : arena.count) n += c >= 3 ? 3 * (c - 2) : 0;
+    return n;
+}
+
+// Polygon i of arena as a triangle fan around its first vertex, calling vertex(x, y) for each
+// GL_TRIANGLES vertex in order
+template<typename Vertex>
+inline void fanPolygon(const PolygonArena& arena, size_t i, Vertex vertex){
+    const float* x = arena.x.data() + arena.first[i];
+    const float* y = arena.y.data() + arena.first[i];
+    for(int k=1;k+1<arena.count[i];k++){
+        vertex(x[0], y[0]);
+        vertex(x[k], y[k]);
+        vertex(x[k+1], y[k+1]);
+    }
+}
@@ -0,0 +1,56 @@
+//Compact vertex format for rasterizer output
+//Pixels are uploaded as int16 window coordinates, two per vertex, and colored by a uniform
+//set once per draw, instead of three floats of NDC each with the color fixed in the shader
+
+#pragma once
+
+#include "glad/glad.h"
+#include "lines.h"
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// Window pixels to NDC, the division of toNDC
+const char* compactVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+
+void main() {
+    gl_Position = vec4(aPos / 400.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* compactFragmentShaderSource = R"(
+#version 330 core
+uniform vec3 color;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(color, 1.0);
+}
+)";
+
+// Attribute 0 of the bound VAO as int16 pixel pairs of the bound GL_ARRAY_BUFFER, converted
+// to float unnormalized so the shader sees whole pixels
+inline void compactVertexAttrib(size_t offset = 0){
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, 2 * sizeof(int16_t), (void*)offset);
+    glEnableVertexAttribArray(0);
+}
+
+// --compact anywhere on the command line
+inline bool compactRequested(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--compact") == 0) return true;
+    }
+    return false;
+}
+
+// Vertex memory of a batch next to what the same vertices take as (x, y, 0) floats
+template<typename T>
+inline void reportVertexMemory(const VertexBatch<T>& batch){
+    size_t bytes = sizeof(T) * batch.vertices.size();
+    size_t floats = sizeof(float) * 3 * batch.vertexCount();
+    std::cout << batch.vertexCount() << " vertices in " << bytes << " bytes, " << floats << " as floats ("
+              << (bytes ? (double)floats / bytes : 0.0) << "x)\n";
+}
@@ -5,9 +5,20 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include "lines.h"
+#include "framebuffer.h"
+#include "thick.h"
+#include "compact.h"
+#include "scene.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
 // Shader sources
@@ -29,7 +40,119 @@ void main() {
 }
 )";
 
-int main(){
+// Fixed-point DDA, SIMD and scalar, against the Bresenham batch on the same segments
+void benchmark(){
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> coord(0, 799);
+
+    std::vector<Segment> segments(200000);
+    for(auto& s : segments){
+        s = {coord(rng), coord(rng), coord(rng), coord(rng)};
+    }
+
+    // Best of three runs into warm output buffers, so page faults are not measured
+    auto bestTime = [](auto rasterize){
+        double best = 1e30;
+        for(int run=0;run<4;run++){
+            auto start = std::chrono::steady_clock::now();
+            rasterize();
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(run > 0) best = std::min(best, t);
+        }
+        return best;
+    };
+
+    LineBatch scalar, simd, bresenham;
+    double scalarTime = bestTime([&]{ ddaBatch<false>(segments, scalar); });
+    double simdTime = bestTime([&]{ ddaBatch(segments, simd); });
+    double bresenhamTime = bestTime([&]{ bresenhamBatch(segments, bresenham); });
+
+    size_t pixels = simd.vertices.size() / 3;
+    std::cout << segments.size() << " segments, " << pixels << " pixels\n";
+    std::cout << "dda scalar:      " << pixels / scalarTime << " pixels/s\n";
+    std::cout << "dda " << ddaLanes << " lanes:     " << pixels / simdTime << " pixels/s\n";
+    std::cout << "bresenhamBatch:  " << pixels / bresenhamTime << " pixels/s\n";
+    std::cout << "simd matches scalar: " << (simd.vertices == scalar.vertices ? "yes" : "no") << "\n";
+
+    // int16 output stores 4 bytes per pixel instead of 12
+    CompactLineBatch compact;
+    double compactTime = bestTime([&]{ ddaBatch(segments, compact); });
+    std::cout << "dda " << ddaLanes << " lanes compact: " << pixels / compactTime << " pixels/s, "
+              << sizeof(int16_t) * compact.vertices.size() / 1048576.0 << " MiB against "
+              << sizeof(float) * simd.vertices.size() / 1048576.0 << " MiB\n";
+
+    // Segments reaching far outside the window, most of their pixels would be thrown away
+    std::uniform_int_distribution<int> wide(-2400, 3200);
+    segments.resize(20000);
+    for(auto& s : segments){
+        s = {wide(rng), wide(rng), wide(rng), wide(rng)};
+    }
+
+    std::vector<WalkRange> ranges;
+    ClipStats stats;
+    double unclippedTime = bestTime([&]{ ddaBatch(segments, simd); });
+    double clipTime = bestTime([&]{ stats = ddaClip(segments, {0, 0, 800, 800}, ranges); });
+    double clippedTime = bestTime([&]{ ddaBatch(segments, ranges, simd); });
+
+    std::cout << "offscreen segments: " << stats.accepted << " inside, " << stats.trimmed << " trimmed, "
+              << stats.rejected << " rejected\n";
+    std::cout << "clipping avoided " << stats.pixelsAvoided() << " of " << stats.pixelsBefore << " pixels ("
+              << 100.0 * stats.pixelsAvoided() / stats.pixelsBefore << "%)\n";
+    std::cout << "unclipped: " << unclippedTime * 1000 << " ms, clip + rasterize: " << (clipTime + clippedTime) * 1000
+              << " ms (clip " << clipTime * 1000 << " ms)\n";
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark();
+        return 0;
+    }
+    // --runs draws each run of pixels as one GL_LINES segment instead of a vertex per pixel
+    bool runMode = runsRequested(argc, argv);
+    // --compact uploads the pixels as int16 window coordinates with the color as a uniform,
+    // a third of the vertex memory
+    bool compact = compactRequested(argc, argv);
+
+    // -0.5..0.5 in NDC, as pixels of the 800x800 window
+    std::vector<Segment> segments = {
+        {200, 200, 600, 600}
+    };
+    // --scene file.scene draws the lines of a scene file instead, read in place from the mapping
+    ArrayView<Segment> drawnSegments = segments;
+    MappedScene scene;
+    std::string scenePath;
+    if(sceneRequested(argc, argv, scenePath)){
+        if(!scene.open(scenePath)){
+            std::cerr << scenePath << ": " << scene.error << "\n";
+            return -1;
+        }
+        drawnSegments = scene.view.segments;
+    }
+    // --thick [width] draws every segment as a quad that many pixels wide
+    float thickWidth = 2.0f;
+    bool thick = thickRequested(argc, argv, thickWidth);
+
+    // --headless [image.ppm|image.png] rasterizes the DDA output into a software framebuffer,
+    // as runs with --runs and as one point per vertex otherwise
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        LineBatch batch;
+        RunBatch runs;
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            if(thick) return drawThickSegments(fb, drawnSegments, thickWidth, rgba(0.0f, 1.0f, 0.0f));
+            if(runMode){
+                runs = ddaRunBatch(drawnSegments);
+                return drawRuns(fb, runs.runs, rgba(0.0f, 1.0f, 0.0f));
+            }
+            std::vector<WalkRange> ranges;
+            ddaClip(drawnSegments, {0, 0, 800, 800}, ranges);
+            ddaBatch(drawnSegments, ranges, batch);
+            return drawPoints(fb, batch.vertices, rgba(0.0f, 1.0f, 0.0f));
+        });
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
@@ -51,30 +174,38 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    std::vector<float> points;
-    float x1, x2, y1, y2;
-
-    x1 = -0.5f, x2 = 0.5f;
-    y1 = -0.5f, y2 = 0.5f;
-
-    float dx = x2 - x1;
-    float dy = y2 - y1;
-
-    int steps = std::max(std::abs(dx), std::abs(dy));
-
-    float x_inc = dx/steps;
-    float y_inc = dy/steps;
-
-    float x = x1, y = y1;
+    // The one time setup is timed as frame 0: generating the pixels and uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+
+    ThickLines lines;
+    if(thick){
+        timer.beginCpu("upload");
+        lines.create();
+        lines.upload(drawnSegments, thickWidth);
+        timer.endCpu("upload");
+    }
 
-    for(int i=0;i<=steps;i++){
-        points.push_back(x);
-        points.push_back(y);
-        points.push_back(0.0f);
-        x += x_inc;
-        y += y_inc;
+    timer.beginCpu("generate");
+    LineBatch batch;
+    CompactLineBatch compactBatch;
+    if(runMode){
+        RunBatch runs = ddaRunBatch(drawnSegments);
+        if(compact) compactBatch.vertices = runsToLines<int16_t>(runs.runs);
+        else batch.vertices = runsToLines(runs.runs);
+    }
+    else{
+        // Only the part of each segment inside the window is rasterized
+        std::vector<WalkRange> ranges;
+        ddaClip(drawnSegments, {0, 0, 800, 800}, ranges);
+        if(compact) ddaBatch(drawnSegments, ranges, compactBatch);
+        else ddaBatch(drawnSegments, ranges, batch);
     }
+    timer.endCpu("generate");
+    if(compact) reportVertexMemory(compactBatch);
 
+    timer.beginCpu("upload");
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -82,20 +213,27 @@ int main(){
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*points.size(), points.data(), GL_STATIC_DRAW);
+    if(compact){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t)*compactBatch.vertices.size(), compactBatch.vertices.data(), GL_STATIC_DRAW);
+        compactVertexAttrib();
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*batch.vertices.size(), batch.vertices.data(), GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
 
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, compact ? &compactVertexShaderSource : &vertexShaderSource, NULL);
     glCompileShader(vertexShader);
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, compact ? &compactFragmentShaderSource : &fragmentShaderSource, NULL);
     glCompileShader(fragmentShader);
 
     unsigned int shaderProgram = glCreateProgram();
@@ -106,7 +244,18 @@ int main(){
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    while(!glfwWindowShouldClose(window)){
+    if(compact){
+        glUseProgram(shaderProgram);
+        glUniform3f(glGetUniformLocation(shaderProgram, "color"), 0.0f, 1.0f, 0.0f);
+    }
+
+    timer.endFrame();
+
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -114,12 +263,30 @@ int main(){
         glUseProgram(shaderProgram);
 
         glLineWidth(2.0f);
-        glDrawArrays(GL_LINE_STRIP, 0, points.size()/3);
-
+        if(thick){
+            lines.draw(0.0f, 1.0f, 0.0f);
+        }
+        else if(runMode){
+            glDrawArrays(GL_LINES, 0, compact ? compactBatch.vertexCount() : batch.vertexCount());
+        }
+        else if(compact){
+            glMultiDrawArrays(GL_LINE_STRIP, compactBatch.first.data(), compactBatch.count.data(), drawnSegments.size());
+        }
+        else{
+            glMultiDrawArrays(GL_LINE_STRIP, batch.first.data(), batch.count.data(), drawnSegments.size());
+        }
+
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
+    if(thick) lines.destroy();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwDestroyWindow(window);
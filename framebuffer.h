@@ -0,0 +1,499 @@
+//Software render target for running the programs without a GL driver
+//Packed RGBA8 pixels, row 0 at the bottom like the GL default framebuffer
+
+#pragma once
+
+#include "lines.h"
+#include "clip.h"
+#include "circle.h"
+#include "scanline.h"
+#include "wu.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// Bytes R, G, B, A in memory, the same layout glReadPixels(GL_RGBA, GL_UNSIGNED_BYTE) returns
+inline uint32_t rgba(float r, float g, float b, float a = 1.0f){
+    auto byte = [](float v){ return (uint32_t)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f); };
+    return byte(r) | byte(g) << 8 | byte(b) << 16 | byte(a) << 24;
+}
+
+struct Framebuffer{
+    int width, height;
+    std::vector<uint32_t> pixels;
+
+    Framebuffer(int w = 800, int h = 800) : width(w), height(h), pixels((size_t)w * h, rgba(0, 0, 0)){}
+
+    void clear(uint32_t color){
+        std::fill(pixels.begin(), pixels.end(), color);
+    }
+
+    Rect bounds() const{
+        return {0, 0, width, height};
+    }
+
+    // The writes are clipped to clip, which must lie inside the framebuffer. The tile
+    // rasterizer passes its tile so threads never touch each other's pixels.
+    void plot(int x, int y, uint32_t color, const Rect& clip){
+        if(x >= clip.x0 && y >= clip.y0 && x < clip.x1 && y < clip.y1){
+            pixels[(size_t)y * width + x] = color;
+        }
+    }
+
+    void plot(int x, int y, uint32_t color){
+        plot(x, y, color, bounds());
+    }
+
+    // Horizontal span [x, x + length) on row y
+    void fillSpan(int x, int y, int length, uint32_t color, const Rect& clip){
+        if(y < clip.y0 || y >= clip.y1) return;
+        int x1 = std::max(x, clip.x0), x2 = std::min(x + length, clip.x1);
+        if(x1 < x2){
+            std::fill(pixels.begin() + (size_t)y * width + x1, pixels.begin() + (size_t)y * width + x2, color);
+        }
+    }
+
+    void fillSpan(int x, int y, int length, uint32_t color){
+        fillSpan(x, y, length, color, bounds());
+    }
+
+    void fillRun(const Run& r, uint32_t color, const Rect& clip){
+        if(!r.vertical){
+            fillSpan(r.x, r.y, r.length, color, clip);
+            return;
+        }
+        if(r.x < clip.x0 || r.x >= clip.x1) return;
+        int y1 = std::max(r.y, clip.y0), y2 = std::min(r.y + r.length, clip.y1);
+        for(int y=y1;y<y2;y++){
+            pixels[(size_t)y * width + r.x] = color;
+        }
+    }
+
+    void fillRun(const Run& r, uint32_t color){
+        fillRun(r, color, bounds());
+    }
+
+    // color over the pixel weighted by coverage, what GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    // blending does with coverage as alpha
+    void blend(int x, int y, uint32_t color, float coverage, const Rect& clip){
+        if(x < clip.x0 || y < clip.y0 || x >= clip.x1 || y >= clip.y1) return;
+        uint32_t& p = pixels[(size_t)y * width + x];
+        int weight = (int)(coverage * 256.0f + 0.5f);
+        uint32_t out = 0;
+        for(int shift=0;shift<32;shift+=8){
+            int d = (p >> shift) & 255, c = (color >> shift) & 255;
+            out |= (uint32_t)(d + (((c - d) * weight) >> 8)) << shift;
+        }
+        p = out;
+    }
+
+    void fillRect(const Rect& r, uint32_t color){
+        for(int y=r.y0;y<r.y1;y++){
+            fillSpan(r.x0, y, r.x1 - r.x0, color, r);
+        }
+    }
+};
+
+// NDC to pixels of the 800x800 window, the inverse of toNDC
+inline int fromNDC(float v){
+    return (int)std::lround((v + 1.0f) * 400.0f);
+}
+
+// The 800x800 window's pixel space, which the line and circle kernels work in, scaled to
+// the framebuffer the same way glViewport(0, 0, width, height) scales NDC
+inline int toFramebufferX(const Framebuffer& fb, float windowPixel){
+    return (int)std::floor(windowPixel * fb.width / 800.0f);
+}
+
+inline int toFramebufferY(const Framebuffer& fb, float windowPixel){
+    return (int)std::floor(windowPixel * fb.height / 800.0f);
+}
+
+// NDC to the framebuffer pixel containing it, as the viewport transform does. The kernels put
+// vertices on integer pixel coordinates and toNDC does not round trip exactly, so a value a
+// hair below an integer counts as that integer.
+inline int ndcToPixelX(const Framebuffer& fb, float x){
+    return (int)std::floor((x + 1.0f) * 0.5f * fb.width + 1.0f / 1024);
+}
+
+inline int ndcToPixelY(const Framebuffer& fb, float y){
+    return (int)std::floor((y + 1.0f) * 0.5f * fb.height + 1.0f / 1024);
+}
+
+inline Segment toFramebuffer(const Framebuffer& fb, const Segment& s){
+    if(fb.width == 800 && fb.height == 800) return s;
+    return {toFramebufferX(fb, s.x1), toFramebufferY(fb, s.y1), toFramebufferX(fb, s.x2), toFramebufferY(fb, s.y2)};
+}
+
+// One segment in framebuffer pixels restricted to clip, returns the pixels written. The walk
+// range inside the clip and where each run ends come from the closed form of the error term,
+// so only the part of the segment inside clip is walked. Same pixels as bresenhamRuns.
+inline size_t drawSegmentClipped(Framebuffer& fb, const Segment& s, uint32_t color, const Rect& clip){
+    WalkRange range = bresenhamClipRange(s, clip);
+    if(range.end <= range.begin) return 0;
+
+    int dx = std::abs(s.x2 - s.x1);
+    int dy = std::abs(s.y2 - s.y1);
+    bool xMajor = dx >= dy;
+    int dMajor = xMajor ? dx : dy;
+    int dMinor = xMajor ? dy : dx;
+    int sx = (s.x1 <= s.x2) ? 1 : -1;
+    int sy = (s.y1 <= s.y2) ? 1 : -1;
+    int majorStep = xMajor ? sx : sy;
+    int minorStep = xMajor ? sy : sx;
+    int a1 = xMajor ? s.x1 : s.y1, b1 = xMajor ? s.y1 : s.x1;
+    long long i0 = range.begin, i1 = range.end - 1;
+
+    if(dMinor == 0){
+        int start = majorStep > 0 ? a1 + (int)i0 : a1 - (int)i1;
+        Run r = xMajor ? Run{start, b1, (int)(i1 - i0 + 1), 0} : Run{b1, start, (int)(i1 - i0 + 1), 1};
+        fb.fillRun(r, color, clip);
+        return r.length;
+    }
+
+    // The next run starts at bresenhamFirstPixel(m + 1), kept as quotient and remainder of
+    // its division so each further run costs an add instead of a divide
+    long long m = bresenhamMinorSteps(i0, dMajor, dMinor);
+    long long divisor = 2LL * dMinor, numerator = 2 * (m + 1) * dMajor - dMajor + divisor;
+    long long next = numerator / divisor, remainder = numerator % divisor;
+    long long stepQuotient = 2LL * dMajor / divisor, stepRemainder = 2LL * dMajor % divisor;
+
+    size_t pixels = 0;
+    for(long long i=i0;i<=i1;){
+        long long end = std::min(i1 + 1, next);
+        int length = (int)(end - i);
+        int a = a1 + majorStep * (int)i, b = b1 + minorStep * (int)m;
+        int start = majorStep > 0 ? a : a - length + 1;
+        Run r = xMajor ? Run{start, b, length, 0} : Run{b, start, length, 1};
+        fb.fillRun(r, color, clip);
+        pixels += length;
+
+        i = end;
+        m++;
+        next += stepQuotient;
+        remainder += stepRemainder;
+        if(remainder >= divisor){
+            remainder -= divisor;
+            next++;
+        }
+    }
+    return pixels;
+}
+
+// Segments as Bresenham runs, returns the pixels written. Only the part of each walk inside
+// the framebuffer is visited.
+inline size_t drawSegments(Framebuffer& fb, ArrayView<Segment> segments, uint32_t color){
+    size_t pixels = 0;
+    for(const Segment& s : segments){
+        pixels += drawSegmentClipped(fb, toFramebuffer(fb, s), color, fb.bounds());
+    }
+    return pixels;
+}
+
+// Segments anti-aliased with Xiaolin Wu's algorithm, blended over what is already there
+inline size_t drawSegmentsAntialiased(Framebuffer& fb, ArrayView<Segment> segments, uint32_t color){
+    thread_local std::vector<Segment> scaled;
+    thread_local CoverageBatch coverage;
+    scaled.resize(segments.size());
+    for(size_t i=0;i<segments.size();i++) scaled[i] = toFramebuffer(fb, segments[i]);
+    wuBatch(scaled, coverage);
+
+    Rect clip = fb.bounds();
+    for(size_t i=0;i<coverage.size();i++){
+        fb.blend(coverage.x[i], coverage.y[i], color, coverage.coverage[i], clip);
+    }
+    return coverage.size();
+}
+
+// Runs in framebuffer pixels. The run kernels work in pixels of the 800x800 window, which
+// are framebuffer pixels at the default size.
+inline size_t drawRuns(Framebuffer& fb, const std::vector<Run>& runs, uint32_t color){
+    size_t pixels = 0;
+    for(const Run& r : runs){
+        fb.fillRun(r, color);
+        pixels += r.length;
+    }
+    return pixels;
+}
+
+// Circle outline with the eight way symmetry and midpointStep walk of midpointCircle,
+// center and radius in framebuffer pixels, writing only the pixels inside clip
+inline size_t drawCircleClipped(Framebuffer& fb, const Circle& c, uint32_t color, const Rect& clip){
+    int x = 0, y = c.r;
+    int p = 1 - c.r;
+    size_t pixels = 0;
+
+    while(x <= y){
+        fb.plot(c.xc + x, c.yc + y, color, clip);
+        fb.plot(c.xc - x, c.yc + y, color, clip);
+        fb.plot(c.xc + x, c.yc - y, color, clip);
+        fb.plot(c.xc - x, c.yc - y, color, clip);
+        fb.plot(c.xc + y, c.yc + x, color, clip);
+        fb.plot(c.xc - y, c.yc + x, color, clip);
+        fb.plot(c.xc + y, c.yc - x, color, clip);
+        fb.plot(c.xc - y, c.yc - x, color, clip);
+        pixels += 8;
+
+        midpointStep(x, y, p);
+    }
+    return pixels;
+}
+
+// Same with center and radius in pixels of the 800x800 window
+inline size_t drawCircle(Framebuffer& fb, const Circle& c, uint32_t color){
+    Circle scaled = {toFramebufferX(fb, c.xc), toFramebufferY(fb, c.yc), toFramebufferX(fb, c.r)};
+    return drawCircleClipped(fb, scaled, color, fb.bounds());
+}
+
+// Filled disc from midpointCircleSpans
+inline size_t fillCircle(Framebuffer& fb, const Circle& c, uint32_t color){
+    int r = toFramebufferX(fb, c.r);
+    std::vector<Run> spans = midpointCircleSpans(toFramebufferX(fb, c.xc), toFramebufferY(fb, c.yc), r);
+    return drawRuns(fb, spans, color);
+}
+
+// NDC vertices (x, y, z) as points, like GL_POINTS with a point size of 1, e.g. the
+// vertices of a LineBatch
+inline size_t drawPoints(Framebuffer& fb, const std::vector<float>& vertices, uint32_t color){
+    for(size_t i=0;i+2<vertices.size();i+=3){
+        fb.plot(ndcToPixelX(fb, vertices[i]), ndcToPixelY(fb, vertices[i+1]), color);
+    }
+    return vertices.size() / 3;
+}
+
+// Square point of size pixels centered on an NDC position, like glPointSize
+inline size_t drawPoint(Framebuffer& fb, float x, float y, int size, uint32_t color){
+    float cx = (x + 1.0f) * 0.5f * fb.width, cy = (y + 1.0f) * 0.5f * fb.height;
+    int x1 = (int)std::floor(cx - size * 0.5f + 0.5f), y1 = (int)std::floor(cy - size * 0.5f + 0.5f);
+    for(int row=y1;row<y1+size;row++){
+        fb.fillSpan(x1, row, size, color);
+    }
+    return (size_t)size * size;
+}
+
+// Filled triangle from NDC vertices, testing the three edge functions at every pixel center of
+// the bounding box. A pixel is covered when its center is inside, with the top-left rule on
+// shared edges, which is how GL decides coverage. Reference for the scanline filler.
+inline size_t fillTriangleEdgeFunctions(Framebuffer& fb, float ax, float ay, float bx, float by, float cx, float cy, uint32_t color,
+                           const Rect& clip){
+    // Vertices in framebuffer pixels
+    float x[3] = {(ax + 1.0f) * 0.5f * fb.width, (bx + 1.0f) * 0.5f * fb.width, (cx + 1.0f) * 0.5f * fb.width};
+    float y[3] = {(ay + 1.0f) * 0.5f * fb.height, (by + 1.0f) * 0.5f * fb.height, (cy + 1.0f) * 0.5f * fb.height};
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(area == 0.0f) return 0;
+    if(area < 0.0f){
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+    }
+
+    int minX = std::max(clip.x0, (int)std::floor(std::min({x[0], x[1], x[2]})));
+    int maxX = std::min(clip.x1 - 1, (int)std::ceil(std::max({x[0], x[1], x[2]})));
+    int minY = std::max(clip.y0, (int)std::floor(std::min({y[0], y[1], y[2]})));
+    int maxY = std::min(clip.y1 - 1, (int)std::ceil(std::max({y[0], y[1], y[2]})));
+
+    size_t pixels = 0;
+    for(int py=minY;py<=maxY;py++){
+        for(int px=minX;px<=maxX;px++){
+            float sx = px + 0.5f, sy = py + 0.5f;
+            bool inside = true;
+            for(int k=0;k<3 && inside;k++){
+                int n = (k + 1) % 3;
+                float ex = x[n] - x[k], ey = y[n] - y[k];
+                float w = ex * (sy - y[k]) - ey * (sx - x[k]);
+                // Counter-clockwise: left edges go down, top edges go left
+                bool topLeft = ey < 0.0f || (ey == 0.0f && ex < 0.0f);
+                inside = w > 0.0f || (w == 0.0f && topLeft);
+            }
+            if(inside){
+                fb.pixels[(size_t)py * fb.width + px] = color;
+                pixels++;
+            }
+        }
+    }
+    return pixels;
+}
+
+inline size_t fillTriangleEdgeFunctions(Framebuffer& fb, float ax, float ay, float bx, float by, float cx, float cy, uint32_t color){
+    return fillTriangleEdgeFunctions(fb, ax, ay, bx, by, cx, cy, color, fb.bounds());
+}
+
+// Filled polygon from n NDC vertices through the scanline filler, even-odd rule
+inline size_t fillPolygon(Framebuffer& fb, const float* x, const float* y, int n, uint32_t color, const Rect& clip){
+    thread_local ScanlineScratch scratch;
+    thread_local std::vector<float> xs, ys;
+    xs.resize(n);
+    ys.resize(n);
+    for(int i=0;i<n;i++){
+        xs[i] = (x[i] + 1.0f) * 0.5f * fb.width;
+        ys[i] = (y[i] + 1.0f) * 0.5f * fb.height;
+    }
+
+    size_t pixels = 0;
+    scanPolygon(xs.data(), ys.data(), n, clip.x0, clip.y0, clip.x1, clip.y1, scratch, [&](int row, int start, int length){
+        std::fill_n(fb.pixels.begin() + (size_t)row * fb.width + start, length, color);
+        pixels += length;
+    });
+    return pixels;
+}
+
+// Filled triangle from NDC vertices, the same pixels as fillTriangleEdgeFunctions
+inline size_t fillTriangle(Framebuffer& fb, float ax, float ay, float bx, float by, float cx, float cy, uint32_t color,
+                           const Rect& clip){
+    float x[] = {ax, bx, cx}, y[] = {ay, by, cy};
+    return fillPolygon(fb, x, y, 3, color, clip);
+}
+
+inline size_t fillTriangle(Framebuffer& fb, float ax, float ay, float bx, float by, float cx, float cy, uint32_t color){
+    return fillTriangle(fb, ax, ay, bx, by, cx, cy, color, fb.bounds());
+}
+
+// GL_TRIANGLES from a vertex buffer of NDC (x, y, z) and an index buffer, like glDrawElements
+inline size_t fillMesh(Framebuffer& fb, const float* vertices, const unsigned int* indices, size_t indexCount,
+                       uint32_t color, const Rect& clip){
+    size_t pixels = 0;
+    for(size_t i=0;i+2<indexCount;i+=3){
+        const float* a = &vertices[indices[i] * 3];
+        const float* b = &vertices[indices[i+1] * 3];
+        const float* c = &vertices[indices[i+2] * 3];
+        pixels += fillTriangle(fb, a[0], a[1], b[0], b[1], c[0], c[1], color, clip);
+    }
+    return pixels;
+}
+
+inline size_t fillMesh(Framebuffer& fb, const float* vertices, const unsigned int* indices, size_t indexCount, uint32_t color){
+    return fillMesh(fb, vertices, indices, indexCount, color, fb.bounds());
+}
+
+// Image output, top row first as image formats expect
+inline bool writePPM(const Framebuffer& fb, const std::string& path){
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << fb.width << " " << fb.height << "\n255\n";
+    std::vector<unsigned char> row(fb.width * 3);
+    for(int y=fb.height-1;y>=0;y--){
+        for(int x=0;x<fb.width;x++){
+            uint32_t p = fb.pixels[(size_t)y * fb.width + x];
+            row[x * 3] = p & 0xff;
+            row[x * 3 + 1] = (p >> 8) & 0xff;
+            row[x * 3 + 2] = (p >> 16) & 0xff;
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+// PNG with uncompressed (stored) deflate blocks, so no zlib is needed
+inline bool writePNG(const Framebuffer& fb, const std::string& path){
+    std::vector<uint32_t> crcTable(256);
+    for(uint32_t n=0;n<256;n++){
+        uint32_t c = n;
+        for(int k=0;k<8;k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    auto put32 = [](std::vector<unsigned char>& v, uint32_t x){
+        v.insert(v.end(), {(unsigned char)(x >> 24), (unsigned char)(x >> 16), (unsigned char)(x >> 8), (unsigned char)x});
+    };
+    auto chunk = [&](const char* type, const std::vector<unsigned char>& data){
+        std::vector<unsigned char> out;
+        put32(out, data.size());
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        uint32_t crc = 0xffffffffu;
+        for(size_t i=4;i<out.size();i++) crc = crcTable[(crc ^ out[i]) & 0xff] ^ (crc >> 8);
+        put32(out, crc ^ 0xffffffffu);
+        file.write((const char*)out.data(), out.size());
+    };
+
+    file.write("\x89PNG\r\n\x1a\n", 8);
+
+    std::vector<unsigned char> header;
+    put32(header, fb.width);
+    put32(header, fb.height);
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    chunk("IHDR", header);
+
+    // Rows of filter byte 0 followed by RGBA
+    std::vector<unsigned char> raw;
+    raw.reserve((size_t)fb.height * (fb.width * 4 + 1));
+    for(int y=fb.height-1;y>=0;y--){
+        raw.push_back(0);
+        const unsigned char* row = (const unsigned char*)&fb.pixels[(size_t)y * fb.width];
+        raw.insert(raw.end(), row, row + fb.width * 4);
+    }
+
+    std::vector<unsigned char> zlib = {0x78, 0x01};
+    for(size_t pos=0;pos<raw.size() || pos==0;){
+        size_t n = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + n == raw.size();
+        zlib.insert(zlib.end(), {(unsigned char)last, (unsigned char)n, (unsigned char)(n >> 8),
+                                 (unsigned char)~n, (unsigned char)(~n >> 8)});
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+        if(last) break;
+    }
+    uint32_t a = 1, b = 0;
+    for(unsigned char c : raw){
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(zlib, b << 16 | a);
+    chunk("IDAT", zlib);
+    chunk("IEND", {});
+    return (bool)file;
+}
+
+// --headless [image.ppm|image.png] renders into a Framebuffer instead of opening a window
+inline bool headlessRequested(int argc, char** argv, std::string& output){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--headless") == 0){
+            // The next argument is the image unless it is another flag
+            output = (i + 1 < argc && argv[i+1][0] != '-') ? argv[i+1] : "";
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes fb as PNG if output ends in .png and as PPM otherwise, nothing if output is empty.
+// Returns the exit code for main.
+inline int writeImage(const Framebuffer& fb, const std::string& output){
+    if(output.empty()) return 0;
+
+    bool png = output.size() > 4 && output.compare(output.size() - 4, 4, ".png") == 0;
+    bool written = png ? writePNG(fb, output) : writePPM(fb, output);
+    if(!written){
+        std::cerr << "could not write " << output << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Renders frames with render() for a fifth of a second, reports the best frame time and
+// writes the last frame if an image path was given. render returns the pixels it wrote.
+template<typename Render>
+inline int renderHeadless(const Framebuffer& fb, const std::string& output, Render render){
+    size_t pixels = 0;
+    int frames = 0;
+    double best = 1e30, total = 0.0;
+    while(frames < 5 || total < 0.2){
+        auto start = std::chrono::steady_clock::now();
+        pixels = render();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+        frames++;
+    }
+
+    std::cout << fb.width << "x" << fb.height << ", " << pixels << " pixels per frame: "
+              << best * 1e3 << " ms per frame, " << 1.0 / best << " frames/s, "
+              << pixels / best << " pixels/s\n";
+    return writeImage(fb, output);
+}
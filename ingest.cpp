@@ -0,0 +1,237 @@
+//Primitives drawn as they arrive on a pipe
+//  producer | ingest [--chunk records] [--headless [image]]
+//  ingest fifo [--chunk records] [--headless [image]]
+//Reads the 32 byte records of ingest.h (scene --emit writes them), draws every chunk over
+//what is already there as soon as it arrives and prints the ingest rate and the latency from
+//arrival to pixels when the stream ends.
+
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include "framebuffer.h"
+#include "ingest.h"
+#include "redraw.h"
+#include "timing.h"
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height){
+    glViewport(0, 0, width, height);
+    requestRedraw(window);
+}
+
+// The accumulated frame as a texture over the window, one triangle covering the viewport
+const char* vertexShaderSource = R"(
+#version 330 core
+out vec2 uv;
+
+void main() {
+    vec2 p = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+    uv = p * 0.5 + 0.5;
+    gl_Position = vec4(p, 0.0, 1.0);
+}
+)";
+
+const char* fragmentShaderSource = R"(
+#version 330 core
+in vec2 uv;
+uniform sampler2D image;
+out vec4 FragColor;
+
+void main() {
+    FragColor = texture(image, uv);
+}
+)";
+
+// Draws the records of chunk over fb through scene, which only holds one chunk at a time.
+// Adds the pixels they may have written to dirty and returns the records addRecord rejected.
+size_t drawChunk(const RecordChunk& chunk, Scene& scene, Framebuffer& fb, Damage& dirty){
+    scene.clear();
+    size_t rejected = 0;
+    for(size_t i=0;i<chunk.count;i++){
+        if(!addRecord(scene, chunk.records[i])) rejected++;
+    }
+    for(const Primitive& p : scene.primitives) dirty.add(primitiveBounds(fb, scene, p));
+    drawScene(scene, fb);
+    return rejected;
+}
+
+int main(int argc, char** argv){
+    // The stream is the first argument that is not a flag, stdin without one
+    std::string path = "-";
+    size_t chunkRecords = 4096;
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--chunk") == 0 && i + 1 < argc){
+            chunkRecords = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if(std::strcmp(argv[i], "--headless") == 0){
+            if(i + 1 < argc && argv[i+1][0] != '-') i++;
+        }
+        else if(argv[i][0] != '-' || std::strcmp(argv[i], "-") == 0){
+            path = argv[i];
+        }
+    }
+
+    RecordReader reader;
+    if(!reader.open(path, chunkRecords)){
+        std::cerr << path << ": " << reader.error << "\n";
+        return -1;
+    }
+    std::cout << "reading " << (path == "-" ? "stdin" : path) << " in chunks of " << chunkRecords << " records ("
+              << reader.chunks.size() * chunkRecords * sizeof(SceneRecord) / 1024.0 << " KiB buffered at most)\n";
+
+    Framebuffer fb(800, 800);
+    Scene scene;
+    IngestStats stats;
+
+    // --headless [image.ppm|image.png] draws into the software framebuffer until the stream
+    // ends, then writes the image
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        while(RecordChunk* chunk = reader.next(true)){
+            Damage dirty;
+            size_t rejected = drawChunk(*chunk, scene, fb, dirty);
+            stats.add(chunk->arrival, chunk->count, rejected, std::chrono::steady_clock::now());
+            reader.release(chunk);
+        }
+        stats.report(reader);
+        return writeImage(fb, imagePath);
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+    GLFWwindow* window = glfwCreateWindow(800, 800, "Ingest", NULL, NULL);
+    if(window == NULL){
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+
+    glViewport(0, 0, 800, 800);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+    // The GPU keeps only this texture, each frame replaces the rectangles the new chunks drew in
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fb.width, fb.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, fb.pixels.data());
+
+    // No vertex data, the shader places the triangle from gl_VertexID
+    unsigned int VAO;
+    glGenVertexArrays(1, &VAO);
+
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glCompileShader(vertexShader);
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glCompileShader(fragmentShader);
+
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    glUseProgram(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "image"), 0);
+
+    // Chunks drawn this frame, their latency ends when the frame is on screen
+    struct Drawn{
+        std::chrono::steady_clock::time_point arrival;
+        size_t count, rejected;
+    };
+    std::vector<Drawn> drawn;
+    bool reported = false;
+
+    // A frame is drawn when the reader has something new, the window sleeps in between
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    reader.onArrival([&]{ redraw.post(); });
+    FrameTimer timer;
+    timer.create(argc, argv);
+    while(redraw.next(window)){
+        timer.beginFrame();
+        // At most one chunk per buffer each frame, so a fast producer still lets frames through
+        timer.beginCpu("generate");
+        Damage dirty;
+        drawn.clear();
+        while(drawn.size() < reader.chunks.size()){
+            RecordChunk* chunk = reader.next(false);
+            if(!chunk) break;
+            size_t rejected = drawChunk(*chunk, scene, fb, dirty);
+            drawn.push_back({chunk->arrival, chunk->count, rejected});
+            reader.release(chunk);
+        }
+        if(drawn.size() == reader.chunks.size()) redraw.request();
+        timer.endCpu("generate");
+
+        timer.beginGpu("upload");
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, fb.width);
+        for(const Rect& r : dirty.rects){
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, GL_RGBA, GL_UNSIGNED_BYTE,
+                            fb.pixels.data() + (size_t)r.y0 * fb.width + r.x0);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        timer.endGpu("upload");
+
+        timer.beginGpu("draw");
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glBindVertexArray(VAO);
+        glUseProgram(shaderProgram);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        timer.endGpu("draw");
+
+        timer.beginCpu("swap");
+        glfwSwapBuffers(window);
+        timer.endCpu("swap");
+        if(!drawn.empty()){
+            glFinish();
+            auto shown = std::chrono::steady_clock::now();
+            for(const Drawn& d : drawn) stats.add(d.arrival, d.count, d.rejected, shown);
+        }
+        if(!reported && reader.done()){
+            stats.report(reader);
+            reported = true;
+        }
+        timer.endFrame();
+    }
+    reader.onArrival(nullptr);
+    if(!reported){
+        reader.close();
+        stats.report(reader);
+    }
+    redraw.report();
+    timer.report();
+    timer.destroy();
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteTextures(1, &texture);
+    glDeleteProgram(shaderProgram);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    return 0;
+}
@@ -0,0 +1,323 @@
+//Streaming scene input
+//Primitives arrive as fixed size records on stdin or a FIFO. A reader thread reads them into a
+//few chunk buffers, hands a chunk to the renderer as soon as a read returns whole records and
+//gets it back once it is drawn, so memory stays at those chunks however long the stream runs.
+
+#pragma once
+
+#include "tiles.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cmath>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// 32 bytes: a PrimitiveKind, the color as rgba() packs it and the primitive in the coordinates
+// of Scene, in native byte order like scene files
+struct SceneRecord{
+    int32_t kind;
+    uint32_t color;
+    union{
+        Segment segment;
+        Circle circle;
+        Triangle triangle;
+    };
+};
+
+static_assert(sizeof(SceneRecord) == 32, "stream records are 32 bytes");
+
+// The record of primitive p of scene
+inline SceneRecord sceneRecord(const SceneView& scene, const Primitive& p){
+    SceneRecord r = {};
+    r.kind = p.kind;
+    r.color = p.color;
+    if(p.kind == LinePrimitive) r.segment = scene.segments[p.index];
+    else if(p.kind == TrianglePrimitive) r.triangle = scene.triangles[p.index];
+    else r.circle = scene.circles[p.index];
+    return r;
+}
+
+// Appends the primitive of r to scene, false for a kind this build does not know or geometry
+// outside the ranges of validSegment, validCircle and validTriangle, which is left out
+inline bool addRecord(Scene& scene, const SceneRecord& r){
+    if(r.kind == LinePrimitive && validSegment(r.segment)) scene.addLine(r.segment, r.color);
+    else if((r.kind == CirclePrimitive || r.kind == DiscPrimitive) && validCircle(r.circle)){
+        scene.addCircle(r.circle, r.color, r.kind == DiscPrimitive);
+    }
+    else if(r.kind == TrianglePrimitive && validTriangle(r.triangle)) scene.addTriangle(r.triangle, r.color);
+    else return false;
+    return true;
+}
+
+// Latencies in power of two buckets of microseconds, bucket k holding [2^(k-1), 2^k) and
+// bucket 0 everything under a microsecond, so any number of samples takes the same memory.
+// Percentiles are the upper end of their bucket, at most twice the true value.
+struct LatencyHistogram{
+    static const int bucketCount = 40;
+    size_t buckets[bucketCount] = {};
+    size_t count = 0;
+    double sum = 0.0, max = 0.0;
+
+    void add(double seconds, size_t weight = 1){
+        double us = seconds * 1e6;
+        int k = 0;
+        while(k < bucketCount - 1 && us >= (double)(1ull << k)) k++;
+        buckets[k] += weight;
+        count += weight;
+        sum += seconds * weight;
+        max = std::max(max, seconds);
+    }
+
+    double mean() const{
+        return count ? sum / count : 0.0;
+    }
+
+    double percentile(double p) const{
+        size_t rank = (size_t)std::ceil(p * count), seen = 0;
+        for(int k=0;k<bucketCount;k++){
+            seen += buckets[k];
+            if(seen >= rank && seen > 0) return std::min((double)(1ull << k) * 1e-6, max);
+        }
+        return max;
+    }
+};
+
+// Records read and not yet drawn, with the time the read returning the first of them ended
+struct RecordChunk{
+    std::vector<SceneRecord> records;
+    size_t count = 0;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// Reads records from a file descriptor on its own thread into chunkCount chunks of
+// chunkRecords records. next() hands chunks out in arrival order and release() gives them
+// back; when all chunks are out the reader stops reading and the producer blocks on the full
+// pipe. A chunk holds what one read returned (at least one record), so a slow stream is drawn
+// record by record while a fast one fills whole chunks.
+struct RecordReader{
+    std::vector<RecordChunk> chunks;
+    std::deque<int> ready, available;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::function<void()> arrived;
+    std::thread thread;
+    int fd = -1;
+    bool ownsFd = false, finished = false, stopping = false;
+    size_t trailing = 0;
+    std::string error;
+
+    RecordReader() = default;
+    RecordReader(const RecordReader&) = delete;
+    RecordReader& operator=(const RecordReader&) = delete;
+
+    ~RecordReader(){
+        close();
+    }
+
+    // path is a file or FIFO, "-" reads stdin
+    bool open(const std::string& path, size_t chunkRecords, int chunkCount = 4){
+        close();
+        if(path == "-"){
+            fd = 0;
+#if defined(_WIN32)
+            _setmode(0, _O_BINARY);
+#endif
+        }
+        else{
+#if defined(_WIN32)
+            fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+            fd = ::open(path.c_str(), O_RDONLY);
+#endif
+            ownsFd = true;
+        }
+        if(fd < 0){
+            error = std::string("cannot open: ") + std::strerror(errno);
+            return false;
+        }
+
+        chunks.resize(chunkCount);
+        for(int i=0;i<chunkCount;i++){
+            chunks[i].records.resize(std::max<size_t>(chunkRecords, 1));
+            available.push_back(i);
+        }
+        thread = std::thread([this]{ run(); });
+        return true;
+    }
+
+    // The next chunk, or nullptr if none has arrived yet (or, with wait, once the stream has
+    // ended and every chunk was handed out)
+    RecordChunk* next(bool wait){
+        std::unique_lock<std::mutex> lock(mutex);
+        if(wait) changed.wait(lock, [&]{ return !ready.empty() || finished; });
+        if(ready.empty()) return nullptr;
+        int i = ready.front();
+        ready.pop_front();
+        return &chunks[i];
+    }
+
+    void release(RecordChunk* chunk){
+        std::lock_guard<std::mutex> lock(mutex);
+        available.push_back((int)(chunk - chunks.data()));
+        changed.notify_all();
+    }
+
+    // Called on the reader thread whenever a chunk is ready or the stream has ended, e.g. to
+    // wake a window waiting for events
+    void onArrival(std::function<void()> callback){
+        std::lock_guard<std::mutex> lock(mutex);
+        arrived = std::move(callback);
+    }
+
+    // The stream has ended and every chunk was handed out
+    bool done(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished && ready.empty();
+    }
+
+    void close(){
+        if(thread.joinable()){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                changed.notify_all();
+            }
+            thread.join();
+        }
+        if(ownsFd && fd >= 0){
+#if defined(_WIN32)
+            _close(fd);
+#else
+            ::close(fd);
+#endif
+        }
+        fd = -1;
+        ownsFd = finished = stopping = false;
+        chunks.clear();
+        ready.clear();
+        available.clear();
+    }
+
+    // Waits for input a tenth of a second at a time so close() is noticed while the producer
+    // is quiet. Windows pipes have no poll(), there close() waits for the next input.
+    bool waitForInput(){
+#if !defined(_WIN32)
+        pollfd p = {fd, POLLIN, 0};
+        while(poll(&p, 1, 100) == 0){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stopping) return false;
+        }
+#endif
+        return true;
+    }
+
+    long readSome(char* data, size_t size){
+#if defined(_WIN32)
+        return _read(fd, data, (unsigned)std::min<size_t>(size, 1u << 30));
+#else
+        long n;
+        do n = ::read(fd, data, size); while(n < 0 && errno == EINTR);
+        return n;
+#endif
+    }
+
+    void run(){
+        // A record split between two reads waits here for its other part
+        char carry[sizeof(SceneRecord)];
+        size_t carried = 0;
+        auto carryArrival = std::chrono::steady_clock::now();
+
+        bool end = false;
+        while(!end){
+            int i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]{ return stopping || !available.empty(); });
+                if(stopping) return;
+                i = available.front();
+                available.pop_front();
+            }
+            RecordChunk& chunk = chunks[i];
+            char* data = (char*)chunk.records.data();
+            size_t capacity = chunk.records.size() * sizeof(SceneRecord);
+            std::memcpy(data, carry, carried);
+            size_t filled = carried;
+            chunk.arrival = carryArrival;
+
+            while(filled < sizeof(SceneRecord)){
+                long n = waitForInput() ? readSome(data + filled, capacity - filled) : 0;
+                if(n <= 0){
+                    if(n < 0) error = std::strerror(errno);
+                    end = true;
+                    break;
+                }
+                if(filled == 0) chunk.arrival = std::chrono::steady_clock::now();
+                filled += n;
+            }
+
+            chunk.count = filled / sizeof(SceneRecord);
+            carried = filled - chunk.count * sizeof(SceneRecord);
+            std::memcpy(carry, data + chunk.count * sizeof(SceneRecord), carried);
+            carryArrival = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if(chunk.count) ready.push_back(i);
+            else available.push_back(i);
+            if(end){
+                finished = true;
+                trailing = carried;
+            }
+            changed.notify_all();
+            if(arrived && (chunk.count || end)) arrived();
+        }
+    }
+};
+
+// Ingest rate over the whole stream and the latency of every record from the read that
+// returned it to the frame showing it
+struct IngestStats{
+    size_t records = 0, rejected = 0, chunks = 0;
+    std::chrono::steady_clock::time_point first, last;
+    LatencyHistogram latency;
+
+    // A chunk of count records that arrived at arrival is on screen at shown
+    void add(std::chrono::steady_clock::time_point arrival, size_t count, size_t rejectedRecords,
+             std::chrono::steady_clock::time_point shown){
+        if(chunks == 0) first = arrival;
+        chunks++;
+        records += count;
+        rejected += rejectedRecords;
+        last = shown;
+        latency.add(std::chrono::duration<double>(shown - arrival).count(), count);
+    }
+
+    void report(const RecordReader& reader) const{
+        double seconds = chunks ? std::chrono::duration<double>(last - first).count() : 0.0;
+        double rate = seconds > 0.0 ? records / seconds : 0.0;
+        std::cout << records << " records (" << rejected << " of unknown kind or out of range) in " << chunks
+                  << " chunks, " << seconds * 1000 << " ms: " << rate << " records/s, "
+                  << rate * sizeof(SceneRecord) / 1048576.0 << " MiB/s\n";
+        std::cout << "arrival to pixels: mean " << latency.mean() * 1000 << " ms, p50 " << latency.percentile(0.5) * 1000
+                  << " ms, p99 " << latency.percentile(0.99) * 1000 << " ms, max " << latency.max * 1000 << " ms\n";
+        if(reader.trailing) std::cerr << "stream ended inside a record, " << reader.trailing << " bytes dropped\n";
+        if(!reader.error.empty()) std::cerr << "read failed: " << reader.error << "\n";
+    }
+};
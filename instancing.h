@@ -0,0 +1,238 @@
+//Instanced triangle drawing shared by the transformation programs
+//One copy of the base triangle is uploaded, every instance applies its own affine transform
+//and color in the vertex shader, so changing a transform uploads 9 floats
+
+#pragma once
+
+#include "glad/glad.h"
+#include "transform.h"
+#include "framebuffer.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+const int maxInstances = 64;
+
+struct Color{
+    float r, g, b;
+};
+
+const char* instancedVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+
+uniform mat3 transforms[64];
+uniform vec3 colors[64];
+
+out vec3 vertexColor;
+
+void main() {
+    vec3 p = transforms[gl_InstanceID] * vec3(aPos, 1.0);
+    gl_Position = vec4(p.xy, 0.0, 1.0);
+    vertexColor = colors[gl_InstanceID];
+}
+)";
+
+// For --clip: the instances are transformed and clipped on the CPU and uploaded as plain
+// colored triangles, so only the part inside the window is sent
+const char* clippedVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec3 aColor;
+
+out vec3 vertexColor;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    vertexColor = aColor;
+}
+)";
+
+// Same for CompactVertex input
+const char* compactClippedVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec4 aColor;
+
+out vec3 vertexColor;
+
+void main() {
+    gl_Position = vec4(aPos / 16384.0, 0.0, 1.0);
+    vertexColor = aColor.rgb;
+}
+)";
+
+const char* instancedFragmentShaderSource = R"(
+#version 330 core
+in vec3 vertexColor;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(vertexColor, 1.0);
+}
+)";
+
+// Affine as a column major mat3 for glUniformMatrix3fv
+inline void affineToMat3(const Affine& m, float* out){
+    float mat[] = {
+        m.a, m.c, 0.0f,
+        m.b, m.d, 0.0f,
+        m.tx, m.ty, 1.0f
+    };
+    std::copy(std::begin(mat), std::end(mat), out);
+}
+
+// Uploads the per instance transforms and colors to the bound program and returns how many
+// instances it uploaded, which is what the draw may use: the uniform arrays hold maxInstances
+// and an instance needs both a transform and a color
+inline int uploadInstances(unsigned int program, const std::vector<Affine>& transforms, const std::vector<Color>& colors){
+    int n = (int)std::min({transforms.size(), colors.size(), (size_t)maxInstances});
+    if(n < (int)transforms.size()) std::cerr << "drawing " << n << " of " << transforms.size() << " instances\n";
+    std::vector<float> mats(n * 9);
+    for(int i=0;i<n;i++){
+        affineToMat3(transforms[i], mats.data() + i * 9);
+    }
+    glUniformMatrix3fv(glGetUniformLocation(program, "transforms"), n, GL_FALSE, mats.data());
+    if(n > 0) glUniform3fv(glGetUniformLocation(program, "colors"), n, &colors[0].r);
+    return n;
+}
+
+// Every instance of the triangle transformed and clipped to box, polygon i of arena being
+// instance i
+inline PolygonClipStats clipInstances(const std::vector<Point>& triangle, const std::vector<Affine>& transforms,
+                                      const ClipBox& box, PolygonArena& arena){
+    PolygonClipStats stats;
+    arena.clear();
+    for(const Affine& m : transforms){
+        float x[3], y[3];
+        for(int k=0;k<3;k++){
+            Point p = applyAffine(m, triangle[k]);
+            x[k] = p.x;
+            y[k] = p.y;
+        }
+        clipPolygon(x, y, 3, box, arena, stats);
+    }
+    return stats;
+}
+
+// Clipped instances as GL_TRIANGLES vertices (x, y, r, g, b), instances drawn in order
+inline void clippedVertices(const PolygonArena& arena, const std::vector<Color>& colors, std::vector<float>& out){
+    out.resize(fanVertexCount(arena) * 5);
+    float* v = out.data();
+    for(size_t i=0;i<arena.size();i++){
+        fanPolygon(arena, i, [&](float x, float y){
+            *v++ = x;
+            *v++ = y;
+            *v++ = colors[i].r;
+            *v++ = colors[i].g;
+            *v++ = colors[i].b;
+        });
+    }
+}
+
+// Compact clipped vertex, 8 bytes instead of 20. Clipping keeps positions within [-1, 1], so
+// they fit int16 as fixed point with 14 fraction bits: 1/16384 of NDC, about 1/40 of a pixel
+// at 800 pixels, and exact for coordinates like 0.5 or 0.25 that normalized int16 (1/32767)
+// would move off pixel centers. The color is an RGBA8 in the byte order of rgba().
+struct CompactVertex{
+    int16_t x, y;
+    uint32_t color;
+};
+
+inline int16_t toFixed14(float v){
+    return (int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 16384.0f);
+}
+
+inline void clippedVertices(const PolygonArena& arena, const std::vector<Color>& colors, std::vector<CompactVertex>& out){
+    out.resize(fanVertexCount(arena));
+    CompactVertex* v = out.data();
+    for(size_t i=0;i<arena.size();i++){
+        uint32_t color = rgba(colors[i].r, colors[i].g, colors[i].b);
+        fanPolygon(arena, i, [&](float x, float y){
+            *v++ = {toFixed14(x), toFixed14(y), color};
+        });
+    }
+}
+
+// Points attributes 0 and 1 of the bound VAO at clippedVertices output starting at offset in
+// the bound GL_ARRAY_BUFFER
+inline void clippedVertexAttribs(bool compact, size_t offset = 0){
+    if(compact){
+        glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, sizeof(CompactVertex), (void*)offset);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), (void*)(offset + offsetof(CompactVertex, color)));
+    }
+    else{
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)offset);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(offset + 2 * sizeof(float)));
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+}
+
+// CPU counterpart of glDrawArraysInstanced for --headless: every instance of the triangle
+// transformed, clipped to the window and filled in order, returns the pixels written.
+// Instances entirely off screen never reach the rasterizer.
+inline size_t fillInstances(Framebuffer& fb, const std::vector<Point>& triangle, const std::vector<Affine>& transforms,
+                            const std::vector<Color>& colors){
+    thread_local PolygonArena arena;
+    clipInstances(triangle, transforms, ndcBox, arena);
+
+    size_t pixels = 0;
+    for(size_t i=0;i<arena.size();i++){
+        if(arena.count[i] == 0) continue;
+        pixels += fillPolygon(fb, arena.x.data() + arena.first[i], arena.y.data() + arena.first[i], arena.count[i],
+                              rgba(colors[i].r, colors[i].g, colors[i].b), fb.bounds());
+    }
+    return pixels;
+}
+
+// Which side of the edge a -> b the point p is on, in pixels
+inline float edgeDistance(Point a, Point b, Point p){
+    float ex = b.x - a.x, ey = b.y - a.y;
+    return (ex * (p.y - a.y) - ey * (p.x - a.x)) / std::sqrt(ex * ex + ey * ey);
+}
+
+// Reads back the current framebuffer and compares it with the instances transformed on the
+// CPU, on a grid of sample pixels away from triangle edges. Later instances are drawn on
+// top. Works in a hidden window on a software driver such as Mesa llvmpipe, e.g.
+// LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./translation --check
+inline bool checkInstances(const std::vector<Point>& triangle, const std::vector<Affine>& transforms,
+                           const std::vector<Color>& colors, Color background, int width, int height){
+    std::vector<unsigned char> pixels(width * height * 4);
+    glFinish();
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    int checked = 0, wrong = 0;
+    for(int py=8;py<height;py+=16){
+        for(int px=8;px<width;px+=16){
+            Point p = {(px + 0.5f) * 2.0f / width - 1.0f, (py + 0.5f) * 2.0f / height - 1.0f};
+            Color expected = background;
+            bool nearEdge = false;
+
+            for(size_t i=0;i<transforms.size();i++){
+                Point v[3];
+                for(int k=0;k<3;k++) v[k] = applyAffine(transforms[i], triangle[k]);
+
+                float d[3];
+                for(int k=0;k<3;k++) d[k] = edgeDistance(v[k], v[(k+1)%3], p) * width / 2.0f;
+                bool inside = (d[0] > 0 && d[1] > 0 && d[2] > 0) || (d[0] < 0 && d[1] < 0 && d[2] < 0);
+                for(int k=0;k<3;k++) nearEdge = nearEdge || std::abs(d[k]) < 2.0f;
+                if(inside) expected = colors[i];
+            }
+            if(nearEdge) continue;
+
+            const unsigned char* got = &pixels[(py * width + px) * 4];
+            checked++;
+            if(std::abs(got[0] - expected.r * 255) > 2 || std::abs(got[1] - expected.g * 255) > 2 ||
+               std::abs(got[2] - expected.b * 255) > 2){
+                wrong++;
+            }
+        }
+    }
+
+    std::cout << checked << " pixels checked, " << wrong << " wrong\n";
+    return checked > 0 && wrong == 0;
+}
@@ -3,12 +3,41 @@
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include "framebuffer.h"
+#include "thick.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
-int main(){
+int main(int argc, char** argv){
+    float vertices[] = {
+        -0.75f, -0.75f, 0.0f, 
+        0.75f, 0.75f, 0.0f 
+    };
+
+    std::vector<Segment> segments = {
+        {fromNDC(vertices[0]), fromNDC(vertices[1]), fromNDC(vertices[3]), fromNDC(vertices[4])}
+    };
+
+    // --thick [width] draws every segment as a quad that many pixels wide
+    float thickWidth = 2.0f;
+    bool thick = thickRequested(argc, argv, thickWidth);
+
+    // --headless [image.ppm|image.png] draws into a software framebuffer instead of a window
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            if(thick) return drawThickSegments(fb, segments, thickWidth, rgba(0.0f, 1.0f, 0.0f));
+            return drawSegments(fb, segments, rgba(0.0f, 1.0f, 0.0f));
+        });
+    }
+
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -30,10 +59,17 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    float vertices[] = {
-        -0.75f, -0.75f, 0.0f, 
-        0.75f, 0.75f, 0.0f 
-    };
+    // The one time setup is timed as frame 0: uploading the line
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+    timer.beginCpu("upload");
+
+    ThickLines lines;
+    if(thick){
+        lines.create();
+        lines.upload(segments, thickWidth);
+    }
 
     //VAO Vertex Array Object
     //VBO Vertex Buffer Object
@@ -51,22 +87,41 @@ int main(){
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
+
+    timer.endFrame();
 
-    while(!glfwWindowShouldClose(window)){
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(0); 
-        glColor3f(0.0f, 1.0f, 0.0f);
+        if(thick){
+            lines.draw(0.0f, 1.0f, 0.0f);
+        }
+        else{
+            glUseProgram(0); 
+            glColor3f(0.0f, 1.0f, 0.0f);
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_LINES, 0, 2);
-        glBindVertexArray(0);
+            glBindVertexArray(VAO);
+            glDrawArrays(GL_LINES, 0, 2);
+            glBindVertexArray(0);
+        }
 
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
+    if(thick) lines.destroy();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwDestroyWindow(window);
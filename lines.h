@@ -0,0 +1,680 @@
+//Line rasterization kernels shared by the line programs
+//Coordinates are in pixels of the 800x800 window, output vertices are NDC (x, y, 0), or in
+//the compact format the window pixels themselves as two int16
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "profile.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Read-only view of contiguous elements, either a std::vector or an array in place elsewhere,
+// such as a memory mapped scene file, so the kernels take both without copying
+template<typename T>
+struct ArrayView{
+    const T* items = nullptr;
+    size_t count = 0;
+
+    ArrayView() = default;
+    ArrayView(const T* items, size_t count) : items(items), count(count){}
+    ArrayView(const std::vector<T>& v) : items(v.data()), count(v.size()){}
+
+    size_t size() const{ return count; }
+    bool empty() const{ return count == 0; }
+    const T* data() const{ return items; }
+    const T* begin() const{ return items; }
+    const T* end() const{ return items + count; }
+    const T& operator[](size_t i) const{ return items[i]; }
+};
+
+struct Segment{
+    int x1, y1, x2, y2;
+};
+
+// Pixels [begin, end) of a segment's walk, pixel 0 being (x1, y1). A clipped segment keeps
+// its own pixels this way, where new integer end points would change the line.
+struct WalkRange{
+    int begin, end;
+};
+
+// Output of a batch: one GL_LINE_STRIP per segment, drawn with glMultiDrawArrays(first, count).
+// T is the vertex component type, see putVertex.
+template<typename T>
+struct VertexBatch{
+    static constexpr int components = sizeof(T) == sizeof(float) ? 3 : 2;
+
+    std::vector<T> vertices;
+    std::vector<int> first;
+    std::vector<int> count;
+
+    size_t vertexCount() const{
+        return vertices.size() / components;
+    }
+};
+
+using LineBatch = VertexBatch<float>;
+using CompactLineBatch = VertexBatch<int16_t>;
+
+inline float toNDC(int v){
+    return v / 400.0f - 1.0f;
+}
+
+// Stores one pixel as a vertex. Every pixel has integer window coordinates and z is always 0,
+// so the compact format keeps just (x, y) as int16, 4 bytes instead of 12, and the vertex
+// shader maps them to NDC. Coordinates beyond int16 saturate to its range, as the packs of the
+// SIMD stores do: such pixels are off screen either way, and since neighbouring pixels and the
+// ends of a run saturate alike, nothing that reaches the window moves.
+inline float* putVertex(float* out, int x, int y){
+    out[0] = toNDC(x);
+    out[1] = toNDC(y);
+    out[2] = 0.0f;
+    return out + 3;
+}
+
+inline int16_t toInt16(int v){
+    return (int16_t)std::min(std::max(v, -32768), 32767);
+}
+
+inline int16_t* putVertex(int16_t* out, int x, int y){
+    out[0] = toInt16(x);
+    out[1] = toInt16(y);
+    return out + 2;
+}
+
+// Bresenham always emits max(dx, dy) + 1 pixels, so output can be sized before rasterizing
+inline int bresenhamPixelCount(const Segment& s){
+    return std::max(std::abs(s.x2 - s.x1), std::abs(s.y2 - s.y1)) + 1;
+}
+
+// Reference single segment loop, appends to points
+inline void bresenhamLine(int x1, int y1, int x2, int y2, std::vector<float>& points){
+    PROFILE_ZONE(zone, "bresenhamLine");
+    size_t size = points.size(), capacity = points.capacity();
+    int dx = std::abs(x2 - x1);
+    int dy = std::abs(y2 - y1);
+
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+
+    int err = dx - dy;
+
+    while(true){
+        points.push_back(toNDC(x1));
+        points.push_back(toNDC(y1));
+        points.push_back(0.0f);
+
+        if (x1 == x2 && y1 == y2) break;
+
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x1 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+    zone.pixels((points.size() - size) / 3);
+    zone.bytes(grownBytes(points, capacity));
+}
+
+// Inner loop for one octant. The major axis and both step signs are template
+// parameters, so the loop runs a fixed count times and only evaluates the error term.
+// Starting at the first pixel with err = 2 * dMinor - dMajor and count = dMajor + 1
+// produces the same pixels as bresenhamLine.
+template<bool XMajor, int SX, int SY, typename T>
+inline T* bresenhamOctant(int x, int y, int dMajor, int dMinor, int err, int count, T* out){
+    for(int i=0;i<count;i++){
+        out = putVertex(out, x, y);
+
+        // The error test becomes a 0/1 step so the compiler can use selects instead of a jump
+        int step = err > 0;
+        if(XMajor) y += SY * step; else x += SX * step;
+        err += 2 * dMinor - 2 * dMajor * step;
+        if(XMajor) x += SX; else y += SY;
+    }
+    return out;
+}
+
+// Closed form of the Bresenham error term: pixel i of a walk has taken
+// (2 i dMinor + dMajor - 1) / (2 dMajor) steps along the minor axis, the same as
+// bresenhamOctant. Lets a rasterizer start anywhere on a segment, e.g. at a clip edge.
+inline long long bresenhamMinorSteps(long long i, int dMajor, int dMinor){
+    return (2 * i * dMinor + dMajor - 1) / (2LL * dMajor);
+}
+
+// First pixel of the walk that has taken m minor steps, dMinor > 0
+inline long long bresenhamFirstPixel(long long m, int dMajor, int dMinor){
+    if(m <= 0) return 0;
+    return (2 * m * dMajor - dMajor + 2LL * dMinor) / (2LL * dMinor);
+}
+
+// Writes pixels [range.begin, range.end) of one segment into out, returns the end of the
+// written range. The octant is picked once here instead of on every pixel.
+template<typename T>
+inline T* bresenhamSegment(const Segment& s, WalkRange range, T* out){
+    PROFILE_ZONE(zone, "bresenhamSegment");
+    int dx = std::abs(s.x2 - s.x1);
+    int dy = std::abs(s.y2 - s.y1);
+    bool right = s.x1 <= s.x2;
+    bool up = s.y1 <= s.y2;
+    int count = range.end - range.begin;
+    if(count <= 0) return out;
+    zone.pixels(count);
+
+    // Position and error term at the first pixel of the range
+    bool xMajor = dx >= dy;
+    int dMajor = xMajor ? dx : dy, dMinor = xMajor ? dy : dx;
+    int i = range.begin;
+    int m = i > 0 ? (int)bresenhamMinorSteps(i, dMajor, dMinor) : 0;
+    int x = s.x1 + (right ? 1 : -1) * (xMajor ? i : m);
+    int y = s.y1 + (up ? 1 : -1) * (xMajor ? m : i);
+    int err = (int)(2LL * (i + 1) * dMinor - dMajor - 2LL * dMajor * m);
+
+    if(xMajor){
+        if(right && up) return bresenhamOctant<true, 1, 1>(x, y, dx, dy, err, count, out);
+        if(right)       return bresenhamOctant<true, 1, -1>(x, y, dx, dy, err, count, out);
+        if(up)          return bresenhamOctant<true, -1, 1>(x, y, dx, dy, err, count, out);
+        return bresenhamOctant<true, -1, -1>(x, y, dx, dy, err, count, out);
+    }
+    if(right && up) return bresenhamOctant<false, 1, 1>(x, y, dy, dx, err, count, out);
+    if(right)       return bresenhamOctant<false, 1, -1>(x, y, dy, dx, err, count, out);
+    if(up)          return bresenhamOctant<false, -1, 1>(x, y, dy, dx, err, count, out);
+    return bresenhamOctant<false, -1, -1>(x, y, dy, dx, err, count, out);
+}
+
+template<typename T>
+inline T* bresenhamSegment(const Segment& s, T* out){
+    return bresenhamSegment(s, {0, bresenhamPixelCount(s)}, out);
+}
+
+// Runs work(begin, end) over contiguous ranges of [0, first.size()) holding roughly equal
+// shares of total, where first[i] is the prefix sum of per-item work. Each range gets its
+// own thread, so with per-item output offsets no two threads write the same memory.
+template<typename Work>
+inline void parallelRanges(const std::vector<int>& first, size_t total, unsigned threads, Work work){
+    size_t n = first.size();
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    // Spawning threads costs more than rasterizing a few thousand pixels
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, total / 16384));
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, n));
+
+    if(threads <= 1){
+        work((size_t)0, n);
+        return;
+    }
+
+    // Cut points where the running total crosses each thread's share
+    std::vector<size_t> cuts(threads + 1, n);
+    cuts[0] = 0;
+    size_t item = 0;
+    for(unsigned t=1;t<threads;t++){
+        size_t target = total * t / threads;
+        while(item < n && (size_t)first[item] < target) item++;
+        cuts[t] = item;
+    }
+
+    std::vector<std::thread> pool;
+    for(unsigned t=0;t+1<threads;t++){
+        pool.emplace_back(work, cuts[t], cuts[t+1]);
+    }
+    work(cuts[threads-1], cuts[threads]);
+    for(auto& th : pool) th.join();
+}
+
+// Sizes batch for segments from the exact pixel counts, reusing its storage when it is
+// filled every frame, and returns the total pixel count
+template<typename T>
+inline size_t layoutLineBatch(ArrayView<Segment> segments, VertexBatch<T>& batch){
+    PROFILE_ZONE(zone, "layoutLineBatch");
+    size_t capacity = batch.vertices.capacity();
+    size_t n = segments.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = bresenhamPixelCount(segments[i]);
+        total += batch.count[i];
+    }
+    batch.vertices.resize(total * batch.components);
+    zone.bytes(grownBytes(batch.vertices, capacity));
+    return total;
+}
+
+// Same with only the pixels in each segment's range, e.g. after clipping
+template<typename T>
+inline size_t layoutLineBatch(const std::vector<WalkRange>& ranges, VertexBatch<T>& batch){
+    PROFILE_ZONE(zone, "layoutLineBatch");
+    size_t capacity = batch.vertices.capacity();
+    size_t n = ranges.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = std::max(0, ranges[i].end - ranges[i].begin);
+        total += batch.count[i];
+    }
+    batch.vertices.resize(total * batch.components);
+    zone.bytes(grownBytes(batch.vertices, capacity));
+    return total;
+}
+
+// Rasterizes a whole buffer of segments. The output is allocated once from the exact
+// pixel counts and filled in parallel, each thread writing only its own segments.
+template<typename T>
+inline void bresenhamBatch(ArrayView<Segment> segments, VertexBatch<T>& batch, unsigned threads = 0){
+    size_t total = layoutLineBatch(segments, batch);
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            bresenhamSegment(segments[i], batch.vertices.data() + (size_t)batch.first[i] * batch.components);
+        }
+    });
+}
+
+// Only the pixels of each segment in its range, segments with an empty range get count 0
+template<typename T>
+inline void bresenhamBatch(ArrayView<Segment> segments, const std::vector<WalkRange>& ranges, VertexBatch<T>& batch,
+                           unsigned threads = 0){
+    size_t total = layoutLineBatch(ranges, batch);
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            bresenhamSegment(segments[i], ranges[i], batch.vertices.data() + (size_t)batch.first[i] * batch.components);
+        }
+    });
+}
+
+inline LineBatch bresenhamBatch(ArrayView<Segment> segments, unsigned threads = 0){
+    LineBatch batch;
+    bresenhamBatch(segments, batch, threads);
+    return batch;
+}
+
+// DDA in 16.16 fixed point, in pixel space. Both coordinates start at v * 65536 + 0x8000
+// and step by a constant increment, the major axis by exactly +-65536 and the minor one by
+// +-(dMinor << 16) / dMajor. Pixel i is (start + i * inc) >> 16, computed with integer adds,
+// so the result does not drift with line length and every code path below is bit-exact.
+// Coordinates must lie within +-32767.
+inline void ddaSetup(const Segment& s, int& accX, int& accY, int& incX, int& incY){
+    int dx = s.x2 - s.x1;
+    int dy = s.y2 - s.y1;
+    int steps = std::max(std::abs(dx), std::abs(dy));
+
+    accX = s.x1 * 65536 + 0x8000;
+    accY = s.y1 * 65536 + 0x8000;
+    if(steps == 0){
+        incX = incY = 0;
+        return;
+    }
+    // Truncating towards zero keeps the last pixel on the end point
+    incX = (int)((long long)dx * 65536 / steps);
+    incY = (int)((long long)dy * 65536 / steps);
+}
+
+// Pixels [range.begin, range.end) of the walk, pixel i starting from start + i * inc
+template<typename T>
+inline T* ddaSegment(const Segment& s, WalkRange range, T* out){
+    PROFILE_ZONE(zone, "ddaSegment");
+    int accX, accY, incX, incY;
+    ddaSetup(s, accX, accY, incX, incY);
+    accX += range.begin * incX;
+    accY += range.begin * incY;
+    int count = range.end - range.begin;
+    zone.pixels(std::max(0, count));
+
+    for(int i=0;i<count;i++){
+        out = putVertex(out, accX >> 16, accY >> 16);
+        accX += incX;
+        accY += incY;
+    }
+    return out;
+}
+
+template<typename T>
+inline T* ddaSegment(const Segment& s, T* out){
+    return ddaSegment(s, {0, bresenhamPixelCount(s)}, out);
+}
+
+#if defined(__AVX2__)
+const int ddaLanes = 8;
+#elif defined(__SSE2__)
+const int ddaLanes = 4;
+#else
+const int ddaLanes = 1;
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Interleaves four x and y values into 12 floats x0 y0 0 x1 | y1 0 x2 y2 | 0 x3 y3 0
+inline float* storeXYZ4(float* out, __m128 x, __m128 y){
+    __m128 zero = _mm_setzero_ps();
+    __m128 lo = _mm_unpacklo_ps(x, y);
+    __m128 hi = _mm_unpackhi_ps(x, y);
+
+    __m128 zx1 = _mm_shuffle_ps(zero, lo, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 y1z = _mm_shuffle_ps(lo, zero, _MM_SHUFFLE(0, 0, 3, 3));
+    __m128 zx3y3 = _mm_shuffle_ps(zero, hi, _MM_SHUFFLE(3, 2, 0, 0));
+
+    _mm_storeu_ps(out, _mm_shuffle_ps(lo, zx1, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(y1z, hi, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(out + 8, _mm_shuffle_ps(zx3y3, zx3y3, _MM_SHUFFLE(0, 3, 2, 0)));
+    return out + 12;
+}
+
+// Stores four pixels given as integer x and y lanes in the format of out
+inline float* storePixels4(float* out, __m128i x, __m128i y){
+    // Same division as toNDC, so the SIMD and scalar results are identical
+    __m128 scale = _mm_set1_ps(400.0f), one = _mm_set1_ps(1.0f);
+    return storeXYZ4(out, _mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(x), scale), one),
+                     _mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(y), scale), one));
+}
+
+inline int16_t* storePixels4(int16_t* out, __m128i x, __m128i y){
+    _mm_storeu_si128((__m128i*)out, _mm_packs_epi32(_mm_unpacklo_epi32(x, y), _mm_unpackhi_epi32(x, y)));
+    return out + 8;
+}
+#endif
+
+#if defined(__AVX2__)
+inline float* storePixels8(float* out, __m256i x, __m256i y){
+    __m256 scale = _mm256_set1_ps(400.0f), one = _mm256_set1_ps(1.0f);
+    __m256 fx = _mm256_sub_ps(_mm256_div_ps(_mm256_cvtepi32_ps(x), scale), one);
+    __m256 fy = _mm256_sub_ps(_mm256_div_ps(_mm256_cvtepi32_ps(y), scale), one);
+    out = storeXYZ4(out, _mm256_castps256_ps128(fx), _mm256_castps256_ps128(fy));
+    return storeXYZ4(out, _mm256_extractf128_ps(fx, 1), _mm256_extractf128_ps(fy, 1));
+}
+
+// The unpacks and the pack work within each 128 bit half, which leaves the pixels in order
+inline int16_t* storePixels8(int16_t* out, __m256i x, __m256i y){
+    _mm256_storeu_si256((__m256i*)out, _mm256_packs_epi32(_mm256_unpacklo_epi32(x, y), _mm256_unpackhi_epi32(x, y)));
+    return out + 16;
+}
+#endif
+
+// Each SIMD lane holds the accumulators of a different pixel of the segment, lane k starting
+// at start + k * inc and stepping by ddaLanes * inc. Integer adds keep this bit-exact with
+// ddaSegment, and the pixels come out in order so the stores stay contiguous.
+template<typename T>
+inline T* ddaSegmentSimd(const Segment& s, WalkRange range, T* out){
+    PROFILE_ZONE(zone, "ddaSegmentSimd");
+    int accX, accY, incX, incY;
+    ddaSetup(s, accX, accY, incX, incY);
+    accX += range.begin * incX;
+    accY += range.begin * incY;
+    int count = range.end - range.begin;
+    zone.pixels(std::max(0, count));
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i ax = _mm256_add_epi32(_mm256_set1_epi32(accX), _mm256_mullo_epi32(lane, _mm256_set1_epi32(incX)));
+    __m256i ay = _mm256_add_epi32(_mm256_set1_epi32(accY), _mm256_mullo_epi32(lane, _mm256_set1_epi32(incY)));
+    __m256i ix = _mm256_set1_epi32(8 * incX), iy = _mm256_set1_epi32(8 * incY);
+
+    for(;i+8<=count;i+=8){
+        out = storePixels8(out, _mm256_srai_epi32(ax, 16), _mm256_srai_epi32(ay, 16));
+        ax = _mm256_add_epi32(ax, ix);
+        ay = _mm256_add_epi32(ay, iy);
+    }
+#elif defined(__SSE2__)
+    __m128i ax = _mm_setr_epi32(accX, accX + incX, accX + 2 * incX, accX + 3 * incX);
+    __m128i ay = _mm_setr_epi32(accY, accY + incY, accY + 2 * incY, accY + 3 * incY);
+    __m128i ix = _mm_set1_epi32(4 * incX), iy = _mm_set1_epi32(4 * incY);
+
+    for(;i+4<=count;i+=4){
+        out = storePixels4(out, _mm_srai_epi32(ax, 16), _mm_srai_epi32(ay, 16));
+        ax = _mm_add_epi32(ax, ix);
+        ay = _mm_add_epi32(ay, iy);
+    }
+#endif
+
+    // Remaining pixels, or all of them without SIMD
+    accX += i * incX;
+    accY += i * incY;
+    for(;i<count;i++){
+        out = putVertex(out, accX >> 16, accY >> 16);
+        accX += incX;
+        accY += incY;
+    }
+    return out;
+}
+
+template<typename T>
+inline T* ddaSegmentSimd(const Segment& s, T* out){
+    return ddaSegmentSimd(s, {0, bresenhamPixelCount(s)}, out);
+}
+
+// Batched DDA with the same output layout as bresenhamBatch. Simd = false runs the scalar
+// loop on every segment, which is what the SIMD path is checked against.
+template<bool Simd = true, typename T>
+inline void ddaBatch(ArrayView<Segment> segments, VertexBatch<T>& batch, unsigned threads = 0){
+    size_t total = layoutLineBatch(segments, batch);
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            T* out = batch.vertices.data() + (size_t)batch.first[i] * batch.components;
+            if(Simd) ddaSegmentSimd(segments[i], out);
+            else ddaSegment(segments[i], out);
+        }
+    });
+}
+
+// Only the pixels of each segment in its range
+template<bool Simd = true, typename T>
+inline void ddaBatch(ArrayView<Segment> segments, const std::vector<WalkRange>& ranges, VertexBatch<T>& batch,
+                     unsigned threads = 0){
+    size_t total = layoutLineBatch(ranges, batch);
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            T* out = batch.vertices.data() + (size_t)batch.first[i] * batch.components;
+            if(Simd) ddaSegmentSimd(segments[i], ranges[i], out);
+            else ddaSegment(segments[i], ranges[i], out);
+        }
+    });
+}
+
+template<bool Simd = true>
+inline LineBatch ddaBatch(ArrayView<Segment> segments, unsigned threads = 0){
+    LineBatch batch;
+    ddaBatch<Simd>(segments, batch, threads);
+    return batch;
+}
+
+// Run-slice output: a run is a horizontal (or vertical) stretch of pixels sharing one row
+// (or column), covering [x, x + length) or [y, y + length). Shallow lines become a few
+// runs instead of one vertex per pixel, which can be filled with memset style writes.
+struct Run{
+    int x, y;
+    int length;
+    int vertical;
+};
+
+struct RunBatch{
+    std::vector<Run> runs;
+    std::vector<int> first;
+    std::vector<int> count;
+};
+
+// Every step along the minor axis starts a new run, so a segment has min(dx, dy) + 1 runs
+inline int runCount(const Segment& s){
+    return std::min(std::abs(s.x2 - s.x1), std::abs(s.y2 - s.y1)) + 1;
+}
+
+// Stores one run given its first pixel along the walk and the walk direction
+inline Run* emitRun(Run* out, int x, int y, int length, bool xMajor, int step){
+    if(xMajor){
+        *out = {step > 0 ? x : x - length + 1, y, length, 0};
+    }
+    else{
+        *out = {x, step > 0 ? y : y - length + 1, length, 1};
+    }
+    return out + 1;
+}
+
+// Run-slice Bresenham. Apart from the first and last, every run is q or q + 1 pixels
+// long with q = dMajor / dMinor, so one error test per run decides between them.
+// Covers exactly the pixels of bresenhamSegment.
+inline Run* bresenhamRuns(const Segment& s, Run* out){
+    PROFILE_ZONE(zone, "bresenhamRuns");
+    zone.pixels(bresenhamPixelCount(s));
+    int dx = std::abs(s.x2 - s.x1);
+    int dy = std::abs(s.y2 - s.y1);
+    bool xMajor = dx >= dy;
+    int dMajor = xMajor ? dx : dy;
+    int dMinor = xMajor ? dy : dx;
+    int sx = (s.x1 <= s.x2) ? 1 : -1;
+    int sy = (s.y1 <= s.y2) ? 1 : -1;
+    int majorStep = xMajor ? sx : sy;
+
+    int x = s.x1, y = s.y1;
+    if(dMinor == 0){
+        return emitRun(out, x, y, dMajor + 1, xMajor, majorStep);
+    }
+
+    int remaining = dMajor + 1;
+    // Same error term as bresenhamOctant, advanced a whole run at a time
+    long long err = 2LL * dMinor - dMajor;
+    long long twoMinor = 2LL * dMinor, twoMajor = 2LL * dMajor;
+
+    int q = dMajor / dMinor;
+    long long shortRun = twoMinor * (q - 1);
+
+    int length = err > 0 ? 1 : (int)(-err / twoMinor) + 2;
+    while(true){
+        length = std::min(length, remaining);
+        out = emitRun(out, x, y, length, xMajor, majorStep);
+        remaining -= length;
+        if(remaining == 0) break;
+
+        err += twoMinor * length - twoMajor;
+        if(xMajor){
+            x += sx * length;
+            y += sy;
+        }
+        else{
+            y += sy * length;
+            x += sx;
+        }
+        length = (err + shortRun > 0) ? q : q + 1;
+    }
+    return out;
+}
+
+// Run-slice DDA in 16.16 fixed point. The minor coordinate of pixel i is
+// (m1 << 16) + 0x8000 + i * inc >> 16 with inc = (dMinor << 16) / dMajor, so the
+// pixel where it changes can be solved for directly, one division per run.
+inline Run* ddaRuns(const Segment& s, Run* out){
+    PROFILE_ZONE(zone, "ddaRuns");
+    zone.pixels(bresenhamPixelCount(s));
+    int dx = std::abs(s.x2 - s.x1);
+    int dy = std::abs(s.y2 - s.y1);
+    bool xMajor = dx >= dy;
+    int dMajor = xMajor ? dx : dy;
+    int dMinor = xMajor ? dy : dx;
+    int sx = (s.x1 <= s.x2) ? 1 : -1;
+    int sy = (s.y1 <= s.y2) ? 1 : -1;
+    int majorStep = xMajor ? sx : sy;
+    int minorStep = xMajor ? sy : sx;
+
+    int x = s.x1, y = s.y1;
+    if(dMinor == 0){
+        return emitRun(out, x, y, dMajor + 1, xMajor, majorStep);
+    }
+
+    long long inc = ((long long)dMinor << 16) / dMajor;
+    int start = 0;
+    for(int k=1;k<=dMinor+1;k++){
+        // First pixel index where the minor coordinate has moved k times
+        long long next;
+        if(k > dMinor) next = dMajor + 1;
+        else if(minorStep > 0) next = ((long long)k * 65536 - 0x8000 + inc - 1) / inc;
+        else next = ((long long)(k - 1) * 65536 + 0x8000) / inc + 1;
+        next = std::min<long long>(next, dMajor + 1);
+
+        int length = (int)next - start;
+        out = emitRun(out, x, y, length, xMajor, majorStep);
+        if(xMajor){
+            x += sx * length;
+            y += sy;
+        }
+        else{
+            y += sy * length;
+            x += sx;
+        }
+        start = (int)next;
+    }
+    return out;
+}
+
+// Runs of a whole buffer of segments, sized exactly and filled in parallel like bresenhamBatch
+template<Run* (*Rasterize)(const Segment&, Run*)>
+inline RunBatch runBatch(ArrayView<Segment> segments, unsigned threads = 0){
+    PROFILE_ZONE(zone, "runBatch");
+    RunBatch batch;
+    size_t n = segments.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = runCount(segments[i]);
+        total += batch.count[i];
+    }
+    batch.runs.resize(total);
+    zone.bytes(grownBytes(batch.runs, 0) + grownBytes(batch.first, 0) + grownBytes(batch.count, 0));
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            Rasterize(segments[i], batch.runs.data() + batch.first[i]);
+        }
+    });
+
+    return batch;
+}
+
+inline RunBatch bresenhamRunBatch(ArrayView<Segment> segments, unsigned threads = 0){
+    return runBatch<bresenhamRuns>(segments, threads);
+}
+
+inline RunBatch ddaRunBatch(ArrayView<Segment> segments, unsigned threads = 0){
+    return runBatch<ddaRuns>(segments, threads);
+}
+
+// Each run as a short GL_LINES segment from its first pixel to one past its last, in the
+// vertex format of T
+template<typename T = float>
+inline std::vector<T> runsToLines(const std::vector<Run>& runs){
+    std::vector<T> lines(runs.size() * 2 * VertexBatch<T>::components);
+    T* out = lines.data();
+    for(const Run& r : runs){
+        int x2 = r.vertical ? r.x : r.x + r.length;
+        int y2 = r.vertical ? r.y + r.length : r.y;
+        out = putVertex(out, r.x, r.y);
+        out = putVertex(out, x2, y2);
+    }
+    return lines;
+}
+
+// --runs anywhere on the command line, each run of pixels drawn as one GL_LINES segment
+inline bool runsRequested(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--runs") == 0) return true;
+    }
+    return false;
+}
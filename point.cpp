@@ -3,8 +3,69 @@
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include "framebuffer.h"
+#include "pointcloud.h"
+#include "redraw.h"
+#include "timing.h"
 
-int main(){
+// count points in gaussian clusters, each cluster its own color
+std::vector<CloudPoint> makeCloud(size_t count){
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> center(-0.7f, 0.7f), spread(0.02f, 0.2f), unit(0.2f, 1.0f);
+    std::vector<CloudPoint> points(count);
+
+    const int clusters = 16;
+    float cx[clusters], cy[clusters], sigma[clusters];
+    uint32_t colors[clusters];
+    for(int k=0;k<clusters;k++){
+        cx[k] = center(rng);
+        cy[k] = center(rng);
+        sigma[k] = spread(rng);
+        colors[k] = rgba(unit(rng), unit(rng), unit(rng));
+    }
+
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    for(size_t i=0;i<count;i++){
+        int k = i % clusters;
+        points[i] = {cx[k] + normal(rng) * sigma[k], cy[k] + normal(rng) * sigma[k], colors[k]};
+    }
+    return points;
+}
+
+int main(int argc, char** argv){
+    // The original red point, or with --cloud [count] that many points (a million by default)
+    std::vector<CloudPoint> points = {{0.0f, 0.0f, rgba(1.0f, 0.0f, 0.0f)}};
+    int pointSize = 10;
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--cloud") == 0){
+            size_t count = (i + 1 < argc && std::atol(argv[i+1]) > 0) ? std::atol(argv[i+1]) : 1000000;
+            points = makeCloud(count);
+            pointSize = 1;
+        }
+    }
+
+    // Only the last point of each point sized cell is drawn, which bounds the work per frame
+    // by the pixel count and is exact for one pixel points
+    auto start = std::chrono::steady_clock::now();
+    std::vector<CloudPoint> visible;
+    densityLOD(points, 800, 800, pointSize, visible);
+    double lodTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << points.size() << " points, " << visible.size() << " after density LOD ("
+              << lodTime * 1000 << " ms)\n";
+
+    // --headless [image.ppm|image.png] draws into a software framebuffer instead of a window
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 1.0f, 1.0f));
+            return drawPointCloud(fb, visible, pointSize);
+        });
+    }
 
     glfwInit();
 
@@ -28,20 +89,44 @@ int main(){
 
     glClearColor(0.0f,1.0f,1.0f,1.0f);
 
-    glPointSize(10.0f);
+    glPointSize((float)pointSize);
+
+    PointCloudRenderer cloud;
+    cloud.create();
+    cloud.setPoints(visible);
 
-    while(!glfwWindowShouldClose(window)){
+    int frames = 0;
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    FrameTimer timer;
+    timer.create(argc, argv);
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClear(GL_COLOR_BUFFER_BIT);
-        
-        glBegin(GL_POINTS);
-        glColor3f(1.0f, 0.0f, 0.0f);
-        glVertex2f(0.0f, 0.0f);      
-        glEnd();
 
+        // A few chunks per frame until the whole cloud is on the GPU
+        if(!cloud.complete()){
+            timer.beginCpu("upload");
+            cloud.upload();
+            timer.endCpu("upload");
+            frames++;
+            if(cloud.complete()) std::cout << "uploaded in " << frames << " frames\n";
+            else redraw.request();
+        }
+        cloud.draw();
+        timer.endGpu("draw");
+
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
+    cloud.destroy();
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -0,0 +1,176 @@
+//Point cloud renderer for millions of points
+//Points live in a VBO as packed (x, y, RGBA8) and are drawn as GL_POINTS, uploaded a few
+//chunks per frame so a large cloud never blocks a frame, and thinned to a density LOD first
+
+#pragma once
+
+#include "glad/glad.h"
+#include "framebuffer.h"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// 12 bytes: NDC position and color in the byte order of rgba()
+struct CloudPoint{
+    float x, y;
+    uint32_t color;
+};
+
+// Pixel column (or row) of an NDC coordinate over size pixels. GL snaps window coordinates to
+// 1/256 of a pixel before deciding which pixel a point lands in, so this does the same.
+// Off screen coordinates give -1 or size.
+inline int cloudPixel(float v, int size){
+    float subpixel = (v + 1.0f) * 0.5f * size * 256.0f + 0.5f;
+    if(!(subpixel >= 0.0f)) return -1;
+    if(subpixel >= size * 256.0f) return size;
+    return (int)subpixel >> 8;
+}
+
+// Keeps, in order, only the last point falling into each cell x cell block of a width x
+// height pixel grid. Opaque points drawn in order leave only the last one per pixel visible,
+// so with one pixel cells and one pixel points the image is unchanged, while what is drawn
+// is bounded by the pixel count however many points there are. Points off screen go too.
+inline void densityLOD(const std::vector<CloudPoint>& points, int width, int height, int cell,
+                       std::vector<CloudPoint>& out){
+    int cellsX = (width + cell - 1) / cell, cellsY = (height + cell - 1) / cell;
+    thread_local std::vector<int> owner;
+    owner.assign((size_t)cellsX * cellsY, -1);
+
+    auto cellOf = [&](const CloudPoint& p) -> long long{
+        int px = cloudPixel(p.x, width), py = cloudPixel(p.y, height);
+        if(px < 0 || py < 0 || px >= width || py >= height) return -1;
+        return (long long)(py / cell) * cellsX + px / cell;
+    };
+
+    for(size_t i=0;i<points.size();i++){
+        long long c = cellOf(points[i]);
+        if(c >= 0) owner[c] = (int)i;
+    }
+
+    out.clear();
+    for(size_t i=0;i<points.size();i++){
+        long long c = cellOf(points[i]);
+        if(c >= 0 && owner[c] == (int)i) out.push_back(points[i]);
+    }
+}
+
+// Software framebuffer counterpart, square points of size pixels like glPointSize
+inline size_t drawPointCloud(Framebuffer& fb, const std::vector<CloudPoint>& points, int size){
+    if(size > 1){
+        size_t pixels = 0;
+        for(const CloudPoint& p : points) pixels += drawPoint(fb, p.x, p.y, size, p.color);
+        return pixels;
+    }
+    for(const CloudPoint& p : points){
+        fb.plot(cloudPixel(p.x, fb.width), cloudPixel(p.y, fb.height), p.color);
+    }
+    return points.size();
+}
+
+const char* cloudVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec4 aColor;
+
+out vec4 vertexColor;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    vertexColor = aColor;
+}
+)";
+
+const char* cloudFragmentShaderSource = R"(
+#version 330 core
+in vec4 vertexColor;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vertexColor;
+}
+)";
+
+// GL side of a point cloud. setPoints only stores the points; upload() then copies up to
+// chunksPerFrame chunks of chunkSize points per call with glBufferSubData, and draw() shows
+// the points uploaded so far, so loading ten million points spreads over a few frames.
+struct PointCloudRenderer{
+    unsigned int program = 0, VAO = 0, VBO = 0;
+    std::vector<CloudPoint> points;
+    size_t uploaded = 0, capacity = 0;
+    size_t chunkSize = 1 << 16;
+    int chunksPerFrame = 4;
+
+    void create(){
+        unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &cloudVertexShaderSource, NULL);
+        glCompileShader(vertexShader);
+
+        unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &cloudFragmentShaderSource, NULL);
+        glCompileShader(fragmentShader);
+
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(CloudPoint), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CloudPoint), (void*)offsetof(CloudPoint, color));
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void setPoints(std::vector<CloudPoint> newPoints){
+        points = std::move(newPoints);
+        uploaded = 0;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if(points.size() > capacity){
+            capacity = points.size();
+            glBufferData(GL_ARRAY_BUFFER, sizeof(CloudPoint) * capacity, NULL, GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    bool complete() const{
+        return uploaded == points.size();
+    }
+
+    // Copies the next chunks, returns the points copied
+    size_t upload(){
+        size_t end = std::min(points.size(), uploaded + chunkSize * chunksPerFrame);
+        if(end == uploaded) return 0;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        for(size_t first=uploaded;first<end;first+=chunkSize){
+            size_t n = std::min(chunkSize, end - first);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(CloudPoint) * first, sizeof(CloudPoint) * n, points.data() + first);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        size_t copied = end - uploaded;
+        uploaded = end;
+        return copied;
+    }
+
+    void draw(){
+        glUseProgram(program);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_POINTS, 0, (int)uploaded);
+        glBindVertexArray(0);
+    }
+
+    void destroy(){
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteProgram(program);
+    }
+};
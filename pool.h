@@ -0,0 +1,136 @@
+//Work-stealing thread pool for the tile rasterizer
+//Threads are started once and reused across frames, the calling thread works as well
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+
+// Every worker has its own queue of task indices. A worker takes tasks from the front of its
+// own queue and, once that is empty, steals from the back of the others, so a worker stuck
+// on an expensive task has its remaining work picked up instead of holding up the frame.
+struct WorkStealingPool{
+    struct Queue{
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::function<void(size_t, unsigned)> job;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    size_t generation = 0;
+    unsigned active = 0;
+    bool stopping = false;
+    std::atomic<size_t> steals{0};
+
+    // threads includes the calling thread, 0 means one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0){
+        if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned i=0;i<threads;i++) queues.push_back(std::make_unique<Queue>());
+        for(unsigned i=1;i<threads;i++) workers.emplace_back(&WorkStealingPool::loop, this, i);
+    }
+
+    ~WorkStealingPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& t : workers) t.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const{
+        return (unsigned)queues.size();
+    }
+
+    // Runs f(task, worker) for every task and returns when all are done. Tasks are dealt out
+    // round robin in the given order, so put the expensive ones first.
+    template<typename F>
+    void run(const std::vector<size_t>& tasks, F f){
+        if(size() == 1){
+            for(size_t t : tasks) f(t, 0u);
+            return;
+        }
+
+        job = f;
+        for(size_t i=0;i<tasks.size();i++){
+            queues[i % size()]->tasks.push_back(tasks[i]);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = (unsigned)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]{ return active == 0; });
+    }
+
+    // Tasks 0 .. count - 1 in order
+    template<typename F>
+    void run(size_t count, F f){
+        std::vector<size_t> tasks(count);
+        for(size_t i=0;i<count;i++) tasks[i] = i;
+        run(tasks, f);
+    }
+
+    bool pop(unsigned worker, size_t& task){
+        {
+            Queue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty()){
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for(unsigned k=1;k<size();k++){
+            Queue& victim = *queues[(worker + k) % size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tasks.empty()){
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(unsigned worker){
+        size_t task;
+        while(pop(worker, task)) job(task, worker);
+    }
+
+    void loop(unsigned worker){
+        size_t seen = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]{ return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+            }
+            drain(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--active == 0) done.notify_all();
+            }
+        }
+    }
+};
@@ -0,0 +1,225 @@
+//Scoped profiling zones inside the geometry kernels
+//Built with -DPROFILE_ZONES, PROFILE_ZONE(zone, "name") at the top of a scope times that scope
+//with the CPU timestamp counter and adds it to the zone's totals of the calling thread, along
+//with whatever the scope counts through zone.pixels(n), zone.points(n) and zone.bytes(n). Each
+//thread keeps its own totals, so zones in the parallel batches take no lock; they are merged
+//when a thread ends and printed per zone (calls, time, p50/p99 in power of two buckets and
+//the counters) when the program exits. Without the define the zone is an empty struct.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(PROFILE_ZONES)
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+const int profileZones = 64;
+const int profileBuckets = 48;
+
+// Timestamp counter ticks where the CPU has one, steady_clock nanoseconds elsewhere
+inline uint64_t profileTicks(){
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The histogram bucket of a call of ticks: 0 for none, else one more than its highest set bit
+inline int profileBucket(uint64_t ticks){
+    if(!ticks) return 0;
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanReverse64(&bit, ticks);
+    int k = (int)bit + 1;
+#else
+    int k = 64 - __builtin_clzll(ticks);
+#endif
+    return k < profileBuckets ? k : profileBuckets - 1;
+}
+
+// One zone on one thread. Bucket k counts the calls of [2^(k-1), 2^k) ticks, bucket 0 those
+// under one tick.
+struct ZoneTotals{
+    uint64_t calls = 0, ticks = 0, maxTicks = 0;
+    uint64_t pixels = 0, points = 0, bytes = 0;
+    uint64_t threads = 0;
+    uint64_t buckets[profileBuckets] = {};
+
+    void merge(const ZoneTotals& t){
+        calls += t.calls;
+        ticks += t.ticks;
+        maxTicks = maxTicks > t.maxTicks ? maxTicks : t.maxTicks;
+        pixels += t.pixels;
+        points += t.points;
+        bytes += t.bytes;
+        threads += t.calls ? 1 : 0;
+        for(int k=0;k<profileBuckets;k++) buckets[k] += t.buckets[k];
+    }
+
+    // Upper end of the bucket holding the p-th call, in ticks
+    uint64_t percentile(double p) const{
+        uint64_t rank = (uint64_t)(p * calls + 0.999999), seen = 0;
+        for(int k=0;k<profileBuckets;k++){
+            seen += buckets[k];
+            if(seen >= rank && seen > 0) return std::min<uint64_t>(1ull << k, maxTicks);
+        }
+        return maxTicks;
+    }
+};
+
+struct ThreadZones;
+
+// Zone names and the totals of threads that have ended. Never destroyed, so a thread that
+// ends during static destruction still has somewhere to put its totals.
+struct ZoneRegistry{
+    std::mutex mutex;
+    std::vector<const char*> names;
+    std::vector<ThreadZones*> live;
+    ZoneTotals retired[profileZones];
+    uint64_t startTicks = profileTicks();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    static ZoneRegistry& get(){
+        static ZoneRegistry* registry = new ZoneRegistry();
+        return *registry;
+    }
+
+    // The id of a zone name, zones of the same name at different places share one
+    int id(const char* name){
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t i=0;i<names.size();i++){
+            if(std::strcmp(names[i], name) == 0) return (int)i;
+        }
+        if(names.size() == profileZones) return -1;
+        names.push_back(name);
+        return (int)names.size() - 1;
+    }
+
+    void report();
+};
+
+// The totals of one thread, merged into the registry when the thread ends
+struct ThreadZones{
+    ZoneTotals zones[profileZones];
+
+    ThreadZones(){
+        ZoneRegistry& r = ZoneRegistry::get();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(this);
+    }
+
+    ~ThreadZones(){
+        ZoneRegistry& r = ZoneRegistry::get();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for(int i=0;i<profileZones;i++) r.retired[i].merge(zones[i]);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), this));
+    }
+
+    static ThreadZones& get(){
+        thread_local ThreadZones zones;
+        return zones;
+    }
+};
+
+// Timestamp counter ticks per nanosecond, measured over the whole run (at least 10 ms)
+inline double profileTicksPerNs(ZoneRegistry& r){
+    auto elapsed = [&]{ return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - r.start).count(); };
+    while(elapsed() < 1e7) std::this_thread::yield();
+    return (profileTicks() - r.startTicks) / elapsed();
+}
+
+// Every zone that ran, summed over the threads that ran it. Threads still running are read
+// as they are.
+inline void ZoneRegistry::report(){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(names.empty()) return;
+    double ns = 1.0 / profileTicksPerNs(*this);
+
+    std::printf("%-22s %10s %4s %10s %9s %9s %9s %10s %12s %12s %12s\n", "zone", "calls", "thr", "total ms", "mean ns",
+                "p50 ns", "p99 ns", "max ns", "pixels", "points", "bytes");
+    for(size_t i=0;i<names.size();i++){
+        ZoneTotals t = retired[i];
+        for(ThreadZones* z : live) t.merge(z->zones[i]);
+        if(!t.calls) continue;
+        std::printf("%-22s %10llu %4llu %10.3f %9.1f %9.0f %9.0f %10.0f %12llu %12llu %12llu\n", names[i],
+                    (unsigned long long)t.calls, (unsigned long long)t.threads, t.ticks * ns * 1e-6, t.ticks * ns / t.calls,
+                    t.percentile(0.5) * ns, t.percentile(0.99) * ns, t.maxTicks * ns, (unsigned long long)t.pixels,
+                    (unsigned long long)t.points, (unsigned long long)t.bytes);
+    }
+    std::fflush(stdout);
+}
+
+// Prints the zones once main has returned or exit() was called
+struct ZoneReportAtExit{
+    ~ZoneReportAtExit(){
+        ZoneRegistry::get().report();
+    }
+};
+
+inline ZoneReportAtExit zoneReportAtExit;
+
+// A zone's place in the code, looked up once on first use
+struct ZoneSite{
+    int id;
+    explicit ZoneSite(const char* name) : id(ZoneRegistry::get().id(name)){}
+};
+
+struct ProfileZone{
+    ZoneTotals* totals;
+    uint64_t begin;
+
+    explicit ProfileZone(const ZoneSite& site)
+        : totals(site.id >= 0 ? &ThreadZones::get().zones[site.id] : nullptr), begin(profileTicks()){}
+
+    ~ProfileZone(){
+        uint64_t ticks = profileTicks() - begin;
+        if(!totals) return;
+        totals->calls++;
+        totals->ticks += ticks;
+        if(ticks > totals->maxTicks) totals->maxTicks = ticks;
+        totals->buckets[profileBucket(ticks)]++;
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+    void pixels(size_t n){ if(totals) totals->pixels += n; }
+    void points(size_t n){ if(totals) totals->points += n; }
+    void bytes(size_t n){ if(totals) totals->bytes += n; }
+};
+
+#define PROFILE_ZONE(zone, name) static ZoneSite zone##Site(name); ProfileZone zone(zone##Site)
+
+#else
+
+// Same calls, no code
+struct ProfileZone{
+    void pixels(size_t){}
+    void points(size_t){}
+    void bytes(size_t){}
+};
+
+#define PROFILE_ZONE(zone, name) [[maybe_unused]] ProfileZone zone
+
+#endif
+
+// Bytes a vector allocated since its capacity was capacityBefore, for zone.bytes()
+template<typename V>
+inline size_t grownBytes(const V& v, size_t capacityBefore){
+    return v.capacity() > capacityBefore ? (v.capacity() - capacityBefore) * sizeof(typename V::value_type) : 0;
+}
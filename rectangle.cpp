@@ -4,12 +4,95 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "framebuffer.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
-int main(){
+// Triangles per second of the scanline filler against per pixel edge functions, on many
+// rectangles in the same vertex + index layout as the one drawn here
+void benchmark(){
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> center(-1.0f, 1.0f), size(0.01f, 0.2f);
+
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    for(unsigned int i=0;i<20000;i++){
+        float x = center(rng), y = center(rng), w = size(rng), h = size(rng);
+        vertices.insert(vertices.end(), {x - w, y - h, 0.0f, x + w, y - h, 0.0f, x + w, y + h, 0.0f, x - w, y + h, 0.0f});
+        indices.insert(indices.end(), {4*i, 4*i + 1, 4*i + 2, 4*i, 4*i + 2, 4*i + 3});
+    }
+    size_t triangles = indices.size() / 3;
+
+    auto bestTime = [](auto fill){
+        double best = 1e30;
+        for(int run=0;run<4;run++){
+            auto start = std::chrono::steady_clock::now();
+            fill();
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(run > 0) best = std::min(best, t);
+        }
+        return best;
+    };
+
+    Framebuffer fb(800, 800);
+    size_t pixels = 0;
+    double edgeTime = bestTime([&]{
+        pixels = 0;
+        for(size_t i=0;i<indices.size();i+=3){
+            const float* a = &vertices[indices[i] * 3];
+            const float* b = &vertices[indices[i+1] * 3];
+            const float* c = &vertices[indices[i+2] * 3];
+            pixels += fillTriangleEdgeFunctions(fb, a[0], a[1], b[0], b[1], c[0], c[1], rgba(1.0f, 1.0f, 1.0f));
+        }
+    });
+    double scanTime = bestTime([&]{ fillMesh(fb, vertices.data(), indices.data(), indices.size(), rgba(1.0f, 1.0f, 1.0f)); });
+
+    RunBatch spans;
+    double batchTime = bestTime([&]{ scanlineBatch(vertices.data(), indices.data(), indices.size(), 800, 800, spans); });
+
+    std::cout << triangles << " triangles, " << pixels << " pixels\n";
+    std::cout << "edge functions:  " << triangles / edgeTime << " triangles/s, " << pixels / edgeTime << " pixels/s\n";
+    std::cout << "scanline fill:   " << triangles / scanTime << " triangles/s, " << pixels / scanTime << " pixels/s\n";
+    std::cout << "scanline spans:  " << triangles / batchTime << " triangles/s, " << spans.runs.size() << " spans ("
+              << std::thread::hardware_concurrency() << " threads)\n";
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark();
+        return 0;
+    }
+
+    float rectangleVertices[] = {
+        -0.7f, -0.2f, 0.0f, // Bottom left
+         0.7f, -0.2f, 0.0f, // Bottom right
+         0.7f,  0.2f, 0.0f, // Top right
+        -0.7f,  0.2f, 0.0f  // Top left
+    };
+
+    unsigned int rectangleIndices[] = {
+        0, 1, 2, // First triangle
+        0, 2, 3  // Second triangle
+    };
+
+    // --headless [image.ppm|image.png] draws into a software framebuffer instead of a window
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            return fillMesh(fb, rectangleVertices, rectangleIndices, 6, rgba(1.0f, 1.0f, 1.0f));
+        });
+    }
+
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -31,18 +114,13 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    float rectangleVertices[] = {
-        -0.7f, -0.2f, 0.0f, // Bottom left
-         0.7f, -0.2f, 0.0f, // Bottom right
-         0.7f,  0.2f, 0.0f, // Top right
-        -0.7f,  0.2f, 0.0f  // Top left
-    };
+    // The one time setup is timed as frame 0: uploading the rectangle
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+    timer.beginCpu("upload");
 
     unsigned int rectangleVAO, rectangleVBO, rectangleEBO;
-    unsigned int rectangleIndices[] = {
-        0, 1, 2, // First triangle
-        0, 2, 3  // Second triangle
-    };
 
     glGenVertexArrays(1, &rectangleVAO);
     glGenBuffers(1, &rectangleVBO);
@@ -60,8 +138,15 @@ int main(){
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
+
+    timer.endFrame();
 
-    while(!glfwWindowShouldClose(window)){
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -69,9 +154,15 @@ int main(){
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
 
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
     glDeleteVertexArrays(1, &rectangleVAO);
     glDeleteBuffers(1, &rectangleVBO);
@@ -0,0 +1,94 @@
+//Render on demand
+//A frame is drawn only when something changed: the first frame, a resize, the window being
+//exposed again or the program asking for one. In between the loop sleeps in glfwWaitEvents
+//instead of drawing the same frame again at full rate. --continuous keeps the busy loop.
+
+#pragma once
+
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+// CPU time of the whole process so far, every thread included
+inline double processSeconds(){
+#if defined(_WIN32)
+    FILETIME created, exited, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+    auto seconds = [](FILETIME t){ return (((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime) * 1e-7; };
+    return seconds(kernel) + seconds(user);
+#else
+    return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Becomes the window's user pointer, so the GLFW callbacks reach it through requestRedraw
+struct Redraw{
+    std::atomic<bool> pending{true};
+    bool continuous = false;
+    size_t frames = 0;
+    std::chrono::steady_clock::time_point start;
+    double cpuStart = 0.0;
+
+    void attach(GLFWwindow* window, bool continuousMode){
+        continuous = continuousMode;
+        glfwSetWindowUserPointer(window, this);
+        glfwSetWindowRefreshCallback(window, [](GLFWwindow* w){
+            if(Redraw* redraw = (Redraw*)glfwGetWindowUserPointer(w)) redraw->request();
+        });
+        start = std::chrono::steady_clock::now();
+        cpuStart = processSeconds();
+    }
+
+    void request(){
+        pending = true;
+    }
+
+    // request() from another thread, waking the main thread out of glfwWaitEvents
+    void post(){
+        pending = true;
+        glfwPostEmptyEvent();
+    }
+
+    // Handles events, waiting for them while no frame is due, and returns true when the
+    // next frame should be drawn or false once the window is closing
+    bool next(GLFWwindow* window){
+        if(frames > 0){
+            if(pending || continuous) glfwPollEvents();
+            while(!pending && !continuous && !glfwWindowShouldClose(window)) glfwWaitEvents();
+        }
+        if(glfwWindowShouldClose(window)) return false;
+        pending = false;
+        frames++;
+        return true;
+    }
+
+    // Frames drawn and the share of one core the process used since attach()
+    void report() const{
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = processSeconds() - cpuStart;
+        std::cout << frames << " frames in " << wall << " s (" << (continuous ? "continuous" : "on demand") << "), "
+                  << (wall > 0.0 ? cpu / wall * 100.0 : 0.0) << "% CPU\n";
+    }
+};
+
+// For the programs' framebuffer size callbacks, which only get the window
+inline void requestRedraw(GLFWwindow* window){
+    if(Redraw* redraw = (Redraw*)glfwGetWindowUserPointer(window)) redraw->request();
+}
+
+// --continuous anywhere on the command line
+inline bool continuousRequested(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--continuous") == 0) return true;
+    }
+    return false;
+}
@@ -6,57 +6,184 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "transform.h"
+#include "instancing.h"
+#include "compact.h"
+#include "stream.h"
+#include "redraw.h"
+#include "timing.h"
 
 
-struct Point{
-    float x,y;
-};  
+void framebuffer_size_callback(GLFWwindow* window, int width, int height){
+    glViewport(0, 0, width, height);
+    requestRedraw(window);
+}
 
-Point rotateFixed(Point p, float angle, float xf, float yf){
-    float rad = angle * M_PI / 180.0;
+// Chained translate, scale and rotate: per point functions into new vectors against one
+// folded matrix applied in place to a PointBuffer
+void benchmark(){
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
 
-    float x_translated = p.x - xf;
-    float y_translated = p.y - yf;
+    std::vector<Point> points(4000000);
+    for(auto& p : points){
+        p = {coord(rng), coord(rng)};
+    }
+    PointBuffer buffer = toPointBuffer(points);
 
-    float x_rotated = x_translated * cos(rad) - y_translated * sin(rad);
-    float y_rotated = x_translated * sin(rad) + y_translated * cos(rad);
+    auto seconds = [](auto start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
 
-    return {x_rotated + xf, y_rotated + yf};
-}
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Point> translated, scaled, rotated;
+    {
+        PROFILE_ZONE(zone, "translate");
+        for(auto& p : points) translated.push_back(translate(p, 0.2f, 0.0f));
+        zone.points(points.size());
+        zone.bytes(grownBytes(translated, 0));
+    }
+    {
+        PROFILE_ZONE(zone, "scaling");
+        for(auto& p : translated) scaled.push_back(scaling(p, 1.0f, 0.5f, 0.0f, 0.0f));
+        zone.points(translated.size());
+        zone.bytes(grownBytes(scaled, 0));
+    }
+    {
+        PROFILE_ZONE(zone, "rotateFixed");
+        for(auto& p : scaled) rotated.push_back(rotateFixed(p, 30.0f, 0.1f, 0.1f));
+        zone.points(scaled.size());
+        zone.bytes(grownBytes(rotated, 0));
+    }
+    double chainTime = seconds(start);
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height){
-    glViewport(0, 0, width, height);
-}
+    start = std::chrono::steady_clock::now();
+    Affine m = affineRotate(30.0f, 0.1f, 0.1f) * affineScale(1.0f, 0.5f, 0.0f, 0.0f) * affineTranslate(0.2f, 0.0f);
+    applyAffine(m, buffer);
+    double affineTime = seconds(start);
 
-// Shader sources
-const char* vertexShaderSource = R"(
-#version 330 core
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec3 aColor;
+    float maxError = 0.0f;
+    for(size_t i=0;i<points.size();i++){
+        maxError = std::max(maxError, std::abs(buffer.x[i] - rotated[i].x));
+        maxError = std::max(maxError, std::abs(buffer.y[i] - rotated[i].y));
+    }
 
-out vec3 vertexColor;
+    std::cout << points.size() << " points, translate + scale + rotate\n";
+    std::cout << "per point functions: " << points.size() / chainTime << " points/s\n";
+    std::cout << "folded Affine, SoA:  " << points.size() / affineTime << " points/s\n";
+    std::cout << "max difference: " << maxError << "\n";
 
-void main() {
-    gl_Position = vec4(aPos, 0.0, 1.0);
-    vertexColor = aColor;
-}
-)";
+    std::uniform_real_distribution<float> angle(-720.0f, 720.0f);
+
+    // Every point with its own angle
+    std::vector<float> angles(points.size());
+    for(auto& a : angles) a = angle(rng);
 
-const char* fragmentShaderSource = R"(
-#version 330 core
-in vec3 vertexColor;
-out vec4 FragColor;
+    start = std::chrono::steady_clock::now();
+    {
+        PROFILE_ZONE(zone, "rotateFixed");
+        for(size_t i=0;i<points.size();i++) rotated[i] = rotateFixed(points[i], angles[i], 0.1f, 0.1f);
+        zone.points(points.size());
+    }
+    double perPointTime = seconds(start);
+
+    buffer = toPointBuffer(points);
+    start = std::chrono::steady_clock::now();
+    rotatePoints(buffer, angles.data(), 0.1f, 0.1f);
+    double sincosTime = seconds(start);
+
+    maxError = 0.0f;
+    for(size_t i=0;i<points.size();i++){
+        maxError = std::max(maxError, std::abs(buffer.x[i] - rotated[i].x));
+        maxError = std::max(maxError, std::abs(buffer.y[i] - rotated[i].y));
+    }
+    std::cout << "rotate, per point angles, rotateFixed: " << points.size() / perPointTime << " points/s\n";
+    std::cout << "rotate, per point angles, sincosDeg:   " << points.size() / sincosTime << " points/s\n";
+    std::cout << "max difference: " << maxError << "\n";
+
+    // Small triangles rotated about pivots spread over three times the window, most of them
+    // off screen or cut by its edges
+    std::vector<Point> triangle = {{-0.1f, -0.1f}, {0.1f, -0.1f}, {0.0f, 0.1f}};
+    std::uniform_real_distribution<float> pivot(-1.5f, 1.5f), offset(-3.0f, 3.0f);
+    std::vector<Affine> transforms(100000);
+    std::vector<Color> colors(transforms.size(), {0.0f, 1.0f, 0.0f});
+    for(auto& m : transforms){
+        m = affineTranslate(offset(rng), offset(rng)) * affineRotate(angle(rng), pivot(rng), pivot(rng));
+    }
 
-void main() {
-    FragColor = vec4(vertexColor, 1.0);
+    Framebuffer fb(800, 800);
+    start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<transforms.size();i++){
+        Point v[3];
+        for(int k=0;k<3;k++) v[k] = applyAffine(transforms[i], triangle[k]);
+        fillTriangle(fb, v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y, rgba(0.0f, 1.0f, 0.0f));
+    }
+    double unclippedTime = seconds(start);
+
+    PolygonArena arena;
+    start = std::chrono::steady_clock::now();
+    PolygonClipStats stats = clipInstances(triangle, transforms, ndcBox, arena);
+    double clipTime = seconds(start);
+    fillInstances(fb, triangle, transforms, colors);
+    double clippedTime = seconds(start) - clipTime;
+
+    std::cout << transforms.size() << " instances: " << stats.accepted << " inside, " << stats.clipped << " clipped, "
+              << stats.rejected << " off screen\n";
+    std::cout << "vertices to upload: " << 3 * transforms.size() << " unclipped, " << fanVertexCount(arena)
+              << " clipped\n";
+    std::cout << "fill unclipped: " << unclippedTime * 1000 << " ms, clip: " << clipTime * 1000
+              << " ms, clip + fill: " << clippedTime * 1000 << " ms\n";
 }
-)";
 
-int main(){
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark();
+        return 0;
+    }
+    // --check renders one frame in a hidden window and compares it with the CPU transform
+    bool check = argc > 1 && std::strcmp(argv[1], "--check") == 0;
+    // --clip transforms and clips the instances on the CPU and uploads only what is on screen
+    bool clipMode = argc > 1 && std::strcmp(argv[1], "--clip") == 0;
+    // --animate turns the green triangle a little every frame, streaming the clipped
+    // triangles through a ring of buffer segments, and reports the upload traffic on exit
+    bool animate = argc > 1 && std::strcmp(argv[1], "--animate") == 0;
+    clipMode = clipMode || animate;
+    // --compact with --clip or --animate uploads 8 byte vertices, 2.14 fixed point positions
+    // and an RGBA8 color, instead of five floats
+    bool compact = clipMode && compactRequested(argc, argv);
+
+    std::vector<Point> og_triangle = {
+        {-0.5f, -0.5f},
+        {0.5f, -0.5f},
+        {0.0f, 0.5f}
+    };
+
+    float angle=180, xf=0.0f, yf=0.0f;
+
+    //Instance 0: original triangle -> white
+    //Instance 1: rotated triangle -> green
+    std::vector<Affine> transforms = {Affine(), affineRotate(angle, xf, yf)};
+    std::vector<Color> colors = {{1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 0.0f}};
+
+    // --headless [image.ppm|image.png] transforms the triangles on the CPU and fills them in a
+    // software framebuffer
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            return fillInstances(fb, og_triangle, transforms, colors);
+        });
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+    if(check) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(800,800,"Rotation", NULL, NULL);
     if(window == NULL){
@@ -74,52 +201,42 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    std::vector<Point> og_triangle = {
-        {-0.5f, -0.5f},
-        {0.5f, -0.5f},
-        {0.0f, 0.5f}
-    };
-
-    float angle=180, xf=0.0f, yf=0.0f;
-
-    std::vector<Point> translated_triangle;
-    for(auto& p : og_triangle){
-        translated_triangle.push_back(rotateFixed(p,angle,xf,yf));
-    }
+    // The one time setup is timed as frame 0: transforming and clipping the instances and
+    // uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
 
+    timer.beginCpu("generate");
     std::vector<float> vertices = {
-        og_triangle[0].x, og_triangle[0].y, 1.0f, 1.0f, 1.0f,
-        og_triangle[1].x, og_triangle[1].y, 1.0f, 1.0f, 1.0f,
-        og_triangle[2].x, og_triangle[2].y, 1.0f, 1.0f, 1.0f,
-
-        translated_triangle[0].x, translated_triangle[0].y, 0.0f, 1.0f, 0.0f,
-        translated_triangle[1].x, translated_triangle[1].y, 0.0f, 1.0f, 0.0f,
-        translated_triangle[2].x, translated_triangle[2].y, 0.0f, 1.0f, 0.0f
+        og_triangle[0].x, og_triangle[0].y,
+        og_triangle[1].x, og_triangle[1].y,
+        og_triangle[2].x, og_triangle[2].y
     };
-
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    std::vector<CompactVertex> compactVertices;
+    size_t vertexCount = 3;
+    PolygonArena arena;
+    PolygonClipStats stats;
+    if(clipMode){
+        stats = clipInstances(og_triangle, transforms, ndcBox, arena);
+        if(compact) clippedVertices(arena, colors, compactVertices);
+        else clippedVertices(arena, colors, vertices);
+        vertexCount = fanVertexCount(arena);
+    }
+    timer.endCpu("generate");
+    if(clipMode){
+        std::cout << stats.accepted << " instances inside, " << stats.clipped << " clipped, " << stats.rejected
+                  << " off screen, " << vertexCount << " vertices uploaded in "
+                  << vertexCount * (compact ? sizeof(CompactVertex) : 5 * sizeof(float)) << " bytes\n";
+    }
 
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, compact ? &compactClippedVertexShaderSource
+                                    : clipMode ? &clippedVertexShaderSource : &instancedVertexShaderSource, NULL);
     glCompileShader(vertexShader);
 
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, &instancedFragmentShaderSource, NULL);
     glCompileShader(fragmentShader);
 
     unsigned int shaderProgram = glCreateProgram();
@@ -130,24 +247,109 @@ int main(){
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    while(!glfwWindowShouldClose(window)){
+    glUseProgram(shaderProgram);
+
+    timer.beginCpu("upload");
+    unsigned int VBO, VAO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if(compact){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex)*compactVertices.size(), compactVertices.data(), GL_STATIC_DRAW);
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    }
+
+    if(clipMode){
+        clippedVertexAttribs(compact);
+    }
+    else{
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    int instanceCount = clipMode ? 0 : uploadInstances(shaderProgram, transforms, colors);
+    timer.endCpu("upload");
+
+    StreamingBuffer stream;
+    if(animate) stream.create(vertexCount * (compact ? sizeof(CompactVertex) : 5 * sizeof(float)));
+
+    timer.endFrame();
+
+    bool passed = true;
+    // --animate turns by half a degree a frame without calling cos and sin again
+    RotationStepper spin(angle, 0.5f);
+    // --animate changes every frame, so it keeps drawing continuously
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv) || animate);
+    while(redraw.next(window)){
+        timer.beginFrame();
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
         glBindVertexArray(VAO);
         glUseProgram(shaderProgram);
 
-        glLineWidth(2.0f);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
+        if(animate){
+            timer.beginCpu("generate");
+            transforms[1] = spin.about(xf, yf);
+            spin.advance();
+            clipInstances(og_triangle, transforms, ndcBox, arena);
+            vertexCount = fanVertexCount(arena);
+            timer.endCpu("generate");
+            size_t offset;
+            timer.beginCpu("upload");
+            if(compact){
+                clippedVertices(arena, colors, compactVertices);
+                offset = stream.upload(compactVertices.data(), sizeof(CompactVertex) * compactVertices.size());
+            }
+            else{
+                clippedVertices(arena, colors, vertices);
+                offset = stream.upload(vertices.data(), sizeof(float) * vertices.size());
+            }
+            clippedVertexAttribs(compact, offset);
+            timer.endCpu("upload");
+        }
+
+        timer.beginGpu("draw");
+        if(clipMode){
+            glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+        }
+        else{
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, instanceCount);
+        }
+        if(animate) stream.fence();
+        timer.endGpu("draw");
+
+        if(check){
+            passed = checkInstances(og_triangle, transforms, colors, {0.0f, 0.0f, 0.0f}, 800, 800);
+            break;
+        }
+
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    if(!check){
+        redraw.report();
+        timer.report();
+    }
+    timer.destroy();
 
+    if(animate){
+        stream.report();
+        stream.destroy();
+    }
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    return 0;
+    return passed ? 0 : 1;
 }
\ No newline at end of file
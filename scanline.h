@@ -0,0 +1,144 @@
+//Edge table / active edge list scanline filler
+//Polygons in framebuffer pixels become horizontal spans. A pixel is covered when its center is
+//inside, with the top-left rule of the GL rasterizer on edges that pass exactly through centers.
+
+#pragma once
+
+#include "lines.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Edge table entry: the edge from (ax, ay) to (ax + ex, ay + ey) crosses the centers of rows
+// yStart .. yEnd, at x on the current row
+struct ScanEdge{
+    int yStart, yEnd;
+    double ax, ay, ex, ey;
+    double x;
+
+    // Evaluated from the end point on every row instead of adding a slope, so an edge that
+    // passes exactly through a pixel center lands exactly on it and the top-left rule holds
+    double at(int row) const{
+        return ax + ex * (row + 0.5 - ay) / ey;
+    }
+};
+
+// Edge table and active edge list, reused across polygons so filling allocates nothing
+struct ScanlineScratch{
+    std::vector<ScanEdge> edges;
+    std::vector<ScanEdge*> active;
+};
+
+// Calls span(y, x, length) for the covered pixels of the polygon (xs[i], ys[i]), n vertices,
+// restricted to columns [x0, x1) and rows [y0, y1). Even-odd rule, so concave and
+// self-intersecting polygons work too.
+//
+// A row belongs to an edge when its center c has yLow < c <= yHigh, which leaves out
+// horizontal edges and counts a shared vertex once. Within a row a span covers centers with
+// xLeft <= c < xRight. Together that includes pixels exactly on left and top edges and
+// leaves them out on right and bottom edges, the same as fillTriangleEdgeFunctions.
+template<typename Span>
+inline void scanPolygon(const float* xs, const float* ys, int n, int x0, int y0, int x1, int y1,
+                        ScanlineScratch& scratch, Span span){
+    std::vector<ScanEdge>& edges = scratch.edges;
+    std::vector<ScanEdge*>& active = scratch.active;
+    edges.clear();
+    active.clear();
+
+    for(int i=0;i<n;i++){
+        int j = (i + 1 == n) ? 0 : i + 1;
+        double ax = xs[i], ay = ys[i], bx = xs[j], by = ys[j];
+        if(ay == by) continue;
+        if(ay > by){
+            std::swap(ax, bx);
+            std::swap(ay, by);
+        }
+        int first = std::max(y0, (int)std::floor(ay - 0.5) + 1);
+        int last = std::min(y1 - 1, (int)std::floor(by - 0.5));
+        if(first > last) continue;
+
+        ScanEdge e = {first, last, ax, ay, bx - ax, by - ay, 0.0};
+        e.x = e.at(first);
+        edges.push_back(e);
+    }
+    std::sort(edges.begin(), edges.end(), [](const ScanEdge& a, const ScanEdge& b){ return a.yStart < b.yStart; });
+
+    size_t next = 0;
+    int y = 0;
+    while(next < edges.size() || !active.empty()){
+        if(active.empty()) y = edges[next].yStart;
+        while(next < edges.size() && edges[next].yStart == y) active.push_back(&edges[next++]);
+
+        // The list is nearly sorted from the previous row, so insertion sort is cheap
+        for(size_t k=1;k<active.size();k++){
+            ScanEdge* e = active[k];
+            size_t m = k;
+            while(m > 0 && active[m-1]->x > e->x){
+                active[m] = active[m-1];
+                m--;
+            }
+            active[m] = e;
+        }
+
+        for(size_t k=0;k+1<active.size();k+=2){
+            int a = std::max(x0, (int)std::ceil(active[k]->x - 0.5));
+            int b = std::min(x1, (int)std::ceil(active[k+1]->x - 0.5));
+            if(a < b) span(y, a, b - a);
+        }
+
+        size_t kept = 0;
+        for(ScanEdge* e : active){
+            if(e->yEnd == y) continue;
+            e->x = e->at(y + 1);
+            active[kept++] = e;
+        }
+        active.resize(kept);
+        y++;
+    }
+}
+
+// A triangle covers at most one span per row, so this bounds its span count
+inline int triangleRowCount(float ay, float by, float cy, int y0, int y1){
+    // Same double arithmetic as scanPolygon so the bound is exact
+    double low = std::min({ay, by, cy}), high = std::max({ay, by, cy});
+    int first = std::max(y0, (int)std::floor(low - 0.5) + 1);
+    int last = std::min(y1 - 1, (int)std::floor(high - 0.5));
+    return std::max(0, last - first + 1);
+}
+
+// Indexed triangles as spans, GL_TRIANGLES over a vertex buffer of NDC (x, y, z) and an index
+// buffer in the EBO layout of rectangle.cpp. Triangle i gets the slots
+// [first[i], first[i] + its row count); count[i] says how many it used, the unused slots hold
+// zero length spans. Triangles are split over threads like the line batches.
+inline void scanlineBatch(const float* vertices, const unsigned int* indices, size_t indexCount,
+                          int width, int height, RunBatch& batch, unsigned threads = 0){
+    size_t n = indexCount / 3;
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    auto pixelY = [&](unsigned int v){ return (vertices[v * 3 + 1] + 1.0f) * 0.5f * height; };
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        total += triangleRowCount(pixelY(indices[i*3]), pixelY(indices[i*3+1]), pixelY(indices[i*3+2]), 0, height);
+    }
+    batch.runs.assign(total, Run{0, 0, 0, 0});
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        ScanlineScratch scratch;
+        for(size_t i=begin;i<end;i++){
+            float xs[3], ys[3];
+            for(int k=0;k<3;k++){
+                unsigned int v = indices[i*3+k];
+                xs[k] = (vertices[v * 3] + 1.0f) * 0.5f * width;
+                ys[k] = (vertices[v * 3 + 1] + 1.0f) * 0.5f * height;
+            }
+            Run* out = batch.runs.data() + batch.first[i];
+            Run* start = out;
+            scanPolygon(xs, ys, 3, 0, 0, width, height, scratch, [&](int y, int x, int length){
+                *out++ = {x, y, length, 0};
+            });
+            batch.count[i] = (int)(out - start);
+        }
+    });
+}
@@ -0,0 +1,232 @@
+//Scene files: converter, load benchmark and viewer
+//  scene input.txt output.scene         converts a text scene (format in scene.h) to a binary one
+//  scene --bench [count]                times loading a generated scene of count primitives
+//  scene file.scene --headless [image]  draws a binary scene with the tile renderer, no GL needed
+//  scene --emit [count] [rate]          writes count generated primitives to stdout as ingest records,
+//                                       at most rate records per second if given, e.g. | ingest
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include "scene.h"
+#include "ingest.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// Lines, circles, discs and triangles in the mix of benchmark.cpp's tile scene
+Scene makeScene(size_t count){
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> coord(0, 799), offset(-100, 100), radius(2, 32), channel(0, 255);
+    std::uniform_real_distribution<float> ndc(-1.0f, 1.0f), size(-0.06f, 0.06f);
+
+    Scene scene;
+    for(size_t i=0;i<count;i++){
+        uint32_t color = channel(rng) | channel(rng) << 8 | channel(rng) << 16 | 0xff000000u;
+        if(i % 5 < 3){
+            int x = coord(rng), y = coord(rng);
+            scene.addLine({x, y, x + offset(rng), y + offset(rng)}, color);
+        }
+        else if(i % 5 == 3){
+            scene.addCircle({coord(rng), coord(rng), radius(rng)}, color, i % 2 == 0);
+        }
+        else{
+            float x = ndc(rng), y = ndc(rng);
+            scene.addTriangle({{x, x + size(rng), x + size(rng)}, {y, y + size(rng), y + size(rng)}}, color);
+        }
+    }
+    return scene;
+}
+
+// Loading the same scene from text, by copying the binary file into vectors, and by mapping it
+void benchmark(size_t count){
+    auto seconds = [](auto start){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    const std::string textPath = "scene_bench.txt", binaryPath = "scene_bench.scene";
+
+    Scene generated = makeScene(count);
+    {
+        std::ofstream text(textPath);
+        writeSceneText(generated, text);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if(!writeScene(generated, binaryPath)){
+        std::cerr << "cannot write " << binaryPath << "\n";
+        return;
+    }
+    double writeTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    Scene parsed;
+    std::string error;
+    std::ifstream text(textPath);
+    readSceneText(text, parsed, error);
+    double textTime = seconds(start);
+
+    MappedScene mapped;
+    start = std::chrono::steady_clock::now();
+    mapped.open(binaryPath, false);
+    double mapTime = seconds(start);
+    mapped.close();
+
+    start = std::chrono::steady_clock::now();
+    mapped.open(binaryPath);
+    double checkedTime = seconds(start);
+
+    // Every page of the mapping read once, what the first frame drawn from it pays
+    start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for(const Segment& s : mapped.view.segments) sum += s.x1 + s.y2;
+    for(const Circle& c : mapped.view.circles) sum += c.r;
+    for(const Triangle& t : mapped.view.triangles) sum += (long long)t.x[0];
+    double touchTime = seconds(start);
+
+    // The arrays copied out of the mapping, as reading the file into vectors would
+    start = std::chrono::steady_clock::now();
+    Scene copied;
+    copied.primitives.assign(mapped.view.primitives.begin(), mapped.view.primitives.end());
+    copied.segments.assign(mapped.view.segments.begin(), mapped.view.segments.end());
+    copied.circles.assign(mapped.view.circles.begin(), mapped.view.circles.end());
+    copied.triangles.assign(mapped.view.triangles.begin(), mapped.view.triangles.end());
+    double copyTime = seconds(start);
+
+    // The parsed text, the generated scene and the mapping must draw the same frame
+    Framebuffer fromText(800, 800), fromMap(800, 800);
+    TileRenderer renderer;
+    renderer.render(parsed, fromText, rgba(0.0f, 0.0f, 0.0f));
+    renderer.render(mapped.view, fromMap, rgba(0.0f, 0.0f, 0.0f));
+    bool same = fromText.pixels == fromMap.pixels && parsed.primitives.size() == generated.primitives.size();
+
+    // One primitive moved: only the tiles under its old and new place are redrawn over the
+    // frame already in fromMap, which must then match drawing the edited scene from scratch
+    Damage damage;
+    Primitive& moved = copied.primitives[0];
+    damage.add(primitiveBounds(fromMap, copied, moved));
+    if(moved.kind == LinePrimitive){
+        Segment& s = copied.segments[moved.index];
+        s = {s.x1 + 37, s.y1 + 23, s.x2 + 37, s.y2 + 23};
+    }
+    else if(moved.kind == TrianglePrimitive){
+        for(float& x : copied.triangles[moved.index].x) x += 0.09f;
+    }
+    else{
+        copied.circles[moved.index].xc += 37;
+    }
+    damage.add(primitiveBounds(fromMap, copied, moved));
+
+    double fullTime = 1e30, damageTime = 1e30;
+    for(int run=0;run<5;run++){
+        start = std::chrono::steady_clock::now();
+        renderer.render(copied, fromText, rgba(0.0f, 0.0f, 0.0f));
+        fullTime = std::min(fullTime, seconds(start));
+        start = std::chrono::steady_clock::now();
+        renderer.render(copied, fromMap, rgba(0.0f, 0.0f, 0.0f), damage.rects);
+        damageTime = std::min(damageTime, seconds(start));
+    }
+    size_t redrawn = std::count(renderer.damaged.begin(), renderer.damaged.end(), 1);
+    bool damageSame = fromText.pixels == fromMap.pixels;
+
+    std::ifstream textSize(textPath, std::ios::binary | std::ios::ate);
+    double mib = 1.0 / 1048576.0;
+    std::cout << count << " primitives, text " << (double)textSize.tellg() * mib << " MiB, binary "
+              << mapped.bytes * mib << " MiB (checksum " << sum << ")\n";
+    std::cout << "write binary:        " << writeTime * 1000 << " ms\n";
+    std::cout << "parse text:          " << textTime * 1000 << " ms, " << count / textTime << " primitives/s\n";
+    std::cout << "map:                 " << mapTime * 1000 << " ms\n";
+    std::cout << "map + check elements:" << checkedTime * 1000 << " ms\n";
+    std::cout << "first touch:         " << touchTime * 1000 << " ms, " << mapped.bytes * mib / touchTime << " MiB/s\n";
+    std::cout << "copy into vectors:   " << copyTime * 1000 << " ms\n";
+    std::cout << "text and mapped scenes draw the same: " << (same ? "yes" : "no") << "\n";
+    std::cout << "one primitive moved: full frame " << fullTime * 1000 << " ms, " << redrawn << " of "
+              << renderer.damaged.size() << " tiles redrawn " << damageTime * 1000 << " ms, same pixels: "
+              << (damageSame ? "yes" : "no") << "\n";
+
+    mapped.close();
+    std::remove(textPath.c_str());
+    std::remove(binaryPath.c_str());
+}
+
+// The records of a generated scene on stdout, paced in batches of a millisecond's worth when a
+// rate is given, the way a live producer would trickle them out
+int emit(size_t count, double rate){
+#if defined(_WIN32)
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    Scene scene = makeScene(count);
+    size_t batch = rate > 0.0 ? std::max<size_t>(1, (size_t)(rate / 1000.0)) : 4096;
+    std::vector<SceneRecord> records;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t first=0;first<count;first+=batch){
+        size_t n = std::min(batch, count - first);
+        records.resize(n);
+        for(size_t i=0;i<n;i++) records[i] = sceneRecord(scene, scene.primitives[first + i]);
+        if(rate > 0.0) std::this_thread::sleep_until(start + std::chrono::duration<double>(first / rate));
+        if(std::fwrite(records.data(), sizeof(SceneRecord), n, stdout) != n) return -1;
+        if(rate > 0.0) std::fflush(stdout);
+    }
+    return std::fflush(stdout) == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::strcmp(argv[1], "--bench") == 0){
+        benchmark(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
+
+    if(argc > 1 && std::strcmp(argv[1], "--emit") == 0){
+        return emit(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000, argc > 3 ? std::atof(argv[3]) : 0.0);
+    }
+
+    std::string imagePath;
+    if(argc > 1 && headlessRequested(argc, argv, imagePath)){
+        MappedScene scene;
+        if(!scene.open(argv[1])){
+            std::cerr << argv[1] << ": " << scene.error << "\n";
+            return -1;
+        }
+        std::cout << scene.view.primitives.size() << " primitives\n";
+        Framebuffer fb(800, 800);
+        TileRenderer renderer;
+        return renderHeadless(fb, imagePath, [&]{
+            renderer.render(scene.view, fb, rgba(0.0f, 0.0f, 0.0f));
+            return fb.pixels.size();
+        });
+    }
+
+    if(argc != 3){
+        std::cerr << "usage: scene input.txt output.scene | scene --bench [count] | scene file.scene --headless [image] | \n"
+                     "scene --emit [count] [rate]\n";
+        return -1;
+    }
+
+    std::ifstream in(argv[1]);
+    if(!in){
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return -1;
+    }
+    Scene scene;
+    std::string error;
+    if(!readSceneText(in, scene, error)){
+        std::cerr << argv[1] << ": " << error << "\n";
+        return -1;
+    }
+    if(!writeScene(scene, argv[2])){
+        std::cerr << "cannot write " << argv[2] << "\n";
+        return -1;
+    }
+    std::cout << scene.segments.size() << " lines, " << scene.circles.size() << " circles, "
+              << scene.triangles.size() << " triangles\n";
+    return 0;
+}
@@ -0,0 +1,349 @@
+//Binary scene files
+//A scene is stored as the four arrays of Scene (tiles.h) behind a small header, every array
+//64 byte aligned and in the memory layout of its struct, so a mapped file is handed to the
+//rasterizers and to glBufferData where it lies, with nothing parsed or copied.
+//Scenes are written from text, one primitive per line, by scene.cpp.
+
+#pragma once
+
+#include "tiles.h"
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <istream>
+#include <ostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const char sceneMagic[8] = "GLSCENE";
+// Bumped whenever the header or a record layout changes, older files are then refused
+const uint32_t sceneVersion = 1;
+// Written as is, reads differently on a machine of the other byte order
+const uint32_t sceneByteOrder = 0x01020304;
+const size_t sceneAlignment = 64;
+
+enum SceneSection{
+    ScenePrimitives, SceneSegments, SceneCircles, SceneTriangles, sceneSectionCount
+};
+
+struct SceneFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    // sizeof of each record type, a build with a different layout refuses the file
+    uint32_t recordSize[sceneSectionCount];
+    // Byte offset in the file and element count of every array
+    uint64_t offset[sceneSectionCount];
+    uint64_t count[sceneSectionCount];
+};
+
+inline uint32_t sceneRecordSize(int section){
+    const uint32_t sizes[sceneSectionCount] = {sizeof(Primitive), sizeof(Segment), sizeof(Circle), sizeof(Triangle)};
+    return sizes[section];
+}
+
+inline size_t alignScene(size_t bytes){
+    return (bytes + sceneAlignment - 1) / sceneAlignment * sceneAlignment;
+}
+
+// Writes the arrays of scene to path with zero padding up to every aligned offset, returns
+// false if the file could not be written
+inline bool writeScene(const SceneView& scene, const std::string& path){
+    const void* arrays[sceneSectionCount] = {scene.primitives.data(), scene.segments.data(), scene.circles.data(),
+                                             scene.triangles.data()};
+    size_t counts[sceneSectionCount] = {scene.primitives.size(), scene.segments.size(), scene.circles.size(),
+                                        scene.triangles.size()};
+
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, sceneMagic, sizeof(header.magic));
+    header.version = sceneVersion;
+    header.byteOrder = sceneByteOrder;
+    size_t offset = alignScene(sizeof(header));
+    for(int k=0;k<sceneSectionCount;k++){
+        header.recordSize[k] = sceneRecordSize(k);
+        header.offset[k] = offset;
+        header.count[k] = counts[k];
+        offset = alignScene(offset + counts[k] * sceneRecordSize(k));
+    }
+
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if(!f) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+    size_t written = sizeof(header);
+    const char zeros[sceneAlignment] = {};
+    for(int k=0;k<sceneSectionCount && ok;k++){
+        size_t padding = header.offset[k] - written;
+        size_t bytes = counts[k] * sceneRecordSize(k);
+        ok = std::fwrite(zeros, 1, padding, f) == padding && (bytes == 0 || std::fwrite(arrays[k], 1, bytes, f) == bytes);
+        written = header.offset[k] + bytes;
+    }
+    return std::fclose(f) == 0 && ok;
+}
+
+// A scene file mapped read-only, view points into the mapping until close(). open() checks
+// the header and that every array lies inside the file; with checkElements it also checks
+// every primitive's kind and index and every element against the ranges of validSegment,
+// validCircle and validTriangle, one pass over the file that makes a damaged file safe to
+// draw, at the cost of touching all its pages up front.
+struct MappedScene{
+    SceneView view;
+    const char* base = nullptr;
+    size_t bytes = 0;
+    std::string error;
+
+    MappedScene() = default;
+    MappedScene(const MappedScene&) = delete;
+    MappedScene& operator=(const MappedScene&) = delete;
+
+    ~MappedScene(){
+        close();
+    }
+
+    bool open(const std::string& path, bool checkElements = true){
+        close();
+        if(!map(path)) return false;
+        if(!validate(checkElements)){
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close(){
+        if(base){
+#if defined(_WIN32)
+            UnmapViewOfFile(base);
+#else
+            munmap((void*)base, bytes);
+#endif
+        }
+        base = nullptr;
+        bytes = 0;
+        view = SceneView();
+    }
+
+    bool map(const std::string& path){
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE){
+            error = "cannot open";
+            return false;
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        bytes = (size_t)size.QuadPart;
+        HANDLE mapping = bytes >= sizeof(SceneFileHeader) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        if(mapping){
+            base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            error = std::string("cannot open: ") + std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        bytes = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+        if(bytes >= sizeof(SceneFileHeader)){
+            void* p = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            base = p == MAP_FAILED ? nullptr : (const char*)p;
+        }
+        ::close(fd);
+#endif
+        if(bytes < sizeof(SceneFileHeader)){
+            error = "too small for a scene header";
+            return false;
+        }
+        if(!base){
+            error = "cannot map";
+            return false;
+        }
+        return true;
+    }
+
+    bool validate(bool checkElements){
+        const SceneFileHeader& header = *(const SceneFileHeader*)base;
+        if(std::memcmp(header.magic, sceneMagic, sizeof(header.magic)) != 0){
+            error = "not a scene file";
+            return false;
+        }
+        if(header.byteOrder != sceneByteOrder){
+            error = "written with the other byte order";
+            return false;
+        }
+        if(header.version != sceneVersion){
+            error = "version " + std::to_string(header.version) + ", expected " + std::to_string(sceneVersion);
+            return false;
+        }
+        for(int k=0;k<sceneSectionCount;k++){
+            if(header.recordSize[k] != sceneRecordSize(k)){
+                error = "record layout differs from this build";
+                return false;
+            }
+            // Compared by count so a huge count cannot overflow the end offset
+            if(header.offset[k] % sceneAlignment != 0 || header.offset[k] > bytes ||
+               header.count[k] > (bytes - header.offset[k]) / sceneRecordSize(k)){
+                error = "array outside the file";
+                return false;
+            }
+        }
+
+        view.primitives = {(const Primitive*)(base + header.offset[ScenePrimitives]), (size_t)header.count[ScenePrimitives]};
+        view.segments = {(const Segment*)(base + header.offset[SceneSegments]), (size_t)header.count[SceneSegments]};
+        view.circles = {(const Circle*)(base + header.offset[SceneCircles]), (size_t)header.count[SceneCircles]};
+        view.triangles = {(const Triangle*)(base + header.offset[SceneTriangles]), (size_t)header.count[SceneTriangles]};
+
+        if(checkElements){
+            for(const Primitive& p : view.primitives){
+                size_t count = p.kind == LinePrimitive ? view.segments.size()
+                             : p.kind == CirclePrimitive || p.kind == DiscPrimitive ? view.circles.size()
+                             : p.kind == TrianglePrimitive ? view.triangles.size() : 0;
+                if(p.index < 0 || (size_t)p.index >= count){
+                    error = "primitive refers to a missing element";
+                    return false;
+                }
+            }
+            bool inRange = std::all_of(view.segments.begin(), view.segments.end(), validSegment) &&
+                           std::all_of(view.circles.begin(), view.circles.end(), validCircle) &&
+                           std::all_of(view.triangles.begin(), view.triangles.end(), validTriangle);
+            if(!inRange){
+                error = "element outside the drawable range";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Text scenes, one primitive per line in Scene's coordinates, '#' starts a comment, the color
+// is optional (white) with channels from 0 to 1:
+//   line x1 y1 x2 y2 [r g b]
+//   circle xc yc r [r g b]
+//   disc xc yc r [r g b]
+//   triangle x0 y0 x1 y1 x2 y2 [r g b]
+// Appends to scene, on a malformed line or one out of the ranges of validSegment,
+// validCircle and validTriangle returns false with its number in error.
+inline bool readSceneText(std::istream& in, Scene& scene, std::string& error){
+    std::string line;
+    int number = 0;
+    while(std::getline(in, line)){
+        number++;
+        const char* p = line.c_str();
+        while(*p == ' ' || *p == '\t') p++;
+        if(*p == '\0' || *p == '#' || *p == '\r') continue;
+
+        const char* word = p;
+        while(*p && *p != ' ' && *p != '\t') p++;
+        std::string kind(word, p);
+
+        bool ok = true, inRange = true;
+        auto integer = [&]{
+            char* end;
+            long v = std::strtol(p, &end, 10);
+            ok = ok && end != p;
+            p = end;
+            return (int)v;
+        };
+        auto real = [&]{
+            char* end;
+            float v = std::strtof(p, &end);
+            ok = ok && end != p;
+            p = end;
+            return v;
+        };
+        // Optional color, all three channels or none
+        auto color = [&]{
+            char* end;
+            float r = std::strtof(p, &end);
+            if(end == p) return rgba(1.0f, 1.0f, 1.0f);
+            p = end;
+            float g = real(), b = real();
+            return rgba(r, g, b);
+        };
+
+        if(kind == "line"){
+            Segment s;
+            s.x1 = integer(); s.y1 = integer(); s.x2 = integer(); s.y2 = integer();
+            uint32_t c = color();
+            inRange = validSegment(s);
+            if(ok && inRange) scene.addLine(s, c);
+        }
+        else if(kind == "circle" || kind == "disc"){
+            Circle c;
+            c.xc = integer(); c.yc = integer(); c.r = integer();
+            uint32_t col = color();
+            inRange = validCircle(c);
+            if(ok && inRange) scene.addCircle(c, col, kind == "disc");
+        }
+        else if(kind == "triangle"){
+            Triangle t;
+            for(int k=0;k<3;k++){
+                t.x[k] = real();
+                t.y[k] = real();
+            }
+            uint32_t c = color();
+            inRange = validTriangle(t);
+            if(ok && inRange) scene.addTriangle(t, c);
+        }
+        else{
+            ok = false;
+        }
+
+        if(!ok){
+            error = "line " + std::to_string(number) + ": cannot read \"" + line + "\"";
+            return false;
+        }
+        if(!inRange){
+            error = "line " + std::to_string(number) + ": outside the drawable range \"" + line + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+// The text form of a scene, readSceneText gives back the same arrays. Colors are written
+// as their byte values over 255, which rgba() maps back to the same bytes.
+inline void writeSceneText(const SceneView& scene, std::ostream& out){
+    char buffer[160];
+    for(const Primitive& p : scene.primitives){
+        float r = (p.color & 0xff) / 255.0f, g = (p.color >> 8 & 0xff) / 255.0f, b = (p.color >> 16 & 0xff) / 255.0f;
+        if(p.kind == LinePrimitive){
+            const Segment& s = scene.segments[p.index];
+            std::snprintf(buffer, sizeof(buffer), "line %d %d %d %d %.9g %.9g %.9g\n", s.x1, s.y1, s.x2, s.y2, r, g, b);
+        }
+        else if(p.kind == TrianglePrimitive){
+            const Triangle& t = scene.triangles[p.index];
+            std::snprintf(buffer, sizeof(buffer), "triangle %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                          t.x[0], t.y[0], t.x[1], t.y[1], t.x[2], t.y[2], r, g, b);
+        }
+        else{
+            const Circle& c = scene.circles[p.index];
+            std::snprintf(buffer, sizeof(buffer), "%s %d %d %d %.9g %.9g %.9g\n", p.kind == DiscPrimitive ? "disc" : "circle",
+                          c.xc, c.yc, c.r, r, g, b);
+        }
+        out << buffer;
+    }
+}
+
+// --scene file.scene anywhere on the command line
+inline bool sceneRequested(int argc, char** argv, std::string& path){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc){
+            path = argv[i+1];
+            return true;
+        }
+    }
+    return false;
+}
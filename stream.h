@@ -0,0 +1,138 @@
+//Streaming vertex buffer for geometry that changes every frame
+//One buffer split into three segments used round robin, each guarded by a fence, so the CPU
+//writes frame N while the GPU may still be reading frames N - 1 and N - 2
+
+#pragma once
+
+#include "glad/glad.h"
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+
+// Upload traffic and how often the CPU had to wait for the GPU
+struct StreamStats{
+    size_t uploads = 0, bytes = 0;
+    size_t stalls = 0, orphans = 0;
+    double copySeconds = 0.0, stallSeconds = 0.0;
+
+    // Bytes per second while copying, the rate the upload path itself sustains
+    double bandwidth() const{
+        return copySeconds > 0.0 ? bytes / copySeconds : 0.0;
+    }
+};
+
+// With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently and coherently,
+// and frames are copied straight into it. Otherwise each frame maps its segment with
+// GL_MAP_UNSYNCHRONIZED_BIT after the fence says the GPU is done with it, and a frame larger
+// than a segment orphans the buffer with glBufferData so no draw in flight is waited on.
+struct StreamingBuffer{
+    static const int segmentCount = 3;
+
+    unsigned int VBO = 0;
+    size_t segmentSize = 0;
+    bool persistent = false;
+    char* mapped = nullptr;
+    GLsync fences[segmentCount] = {};
+    int segment = segmentCount - 1;
+    StreamStats stats;
+
+    void create(size_t bytesPerFrame){
+        persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+        allocate(std::max<size_t>(bytesPerFrame, 4096));
+    }
+
+    void allocate(size_t bytes){
+        segmentSize = bytes;
+        glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if(persistent){
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, segmentSize * segmentCount, NULL, flags);
+            mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, segmentSize * segmentCount, flags);
+        }
+        else{
+            glBufferData(GL_ARRAY_BUFFER, segmentSize * segmentCount, NULL, GL_STREAM_DRAW);
+        }
+    }
+
+    // Waits until the GPU has finished the draws that read segment i, counting a stall only
+    // when the fence was not already signaled
+    void wait(int i){
+        if(!fences[i]) return;
+        if(glClientWaitSync(fences[i], 0, 0) == GL_TIMEOUT_EXPIRED){
+            auto start = std::chrono::steady_clock::now();
+            while(glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED){}
+            stats.stalls++;
+            stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+
+    // Copies this frame's vertices into the next segment and returns their byte offset in
+    // VBO, which stays bound to GL_ARRAY_BUFFER. Call fence() after the draws that use them.
+    size_t upload(const void* data, size_t bytes){
+        if(bytes > segmentSize){
+            // Too big for the ring: a fresh, larger store, the old one is freed by the driver
+            // once the draws still using it are done
+            for(int i=0;i<segmentCount;i++){
+                if(fences[i]) glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+            if(persistent){
+                glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+                glDeleteBuffers(1, &VBO);
+                allocate(bytes * 2);
+            }
+            else{
+                segmentSize = bytes * 2;
+                glBindBuffer(GL_ARRAY_BUFFER, VBO);
+                glBufferData(GL_ARRAY_BUFFER, segmentSize * segmentCount, NULL, GL_STREAM_DRAW);
+            }
+            stats.orphans++;
+        }
+
+        segment = (segment + 1) % segmentCount;
+        wait(segment);
+        size_t offset = segment * segmentSize;
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        auto start = std::chrono::steady_clock::now();
+        if(persistent){
+            std::memcpy(mapped + offset, data, bytes);
+        }
+        else{
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            void* p = glMapBufferRange(GL_ARRAY_BUFFER, offset, std::max<size_t>(bytes, 1), flags);
+            std::memcpy(p, data, bytes);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        stats.copySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.uploads++;
+        stats.bytes += bytes;
+        return offset;
+    }
+
+    // Marks the end of the draws reading the current segment
+    void fence(){
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void destroy(){
+        for(int i=0;i<segmentCount;i++){
+            if(fences[i]) glDeleteSync(fences[i]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if(persistent) glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDeleteBuffers(1, &VBO);
+    }
+
+    void report() const{
+        std::cout << (persistent ? "persistent" : "unsynchronized") << " stream: " << stats.uploads << " uploads, "
+                  << stats.bytes / 1048576.0 << " MiB at " << stats.bandwidth() / 1048576.0 << " MiB/s, "
+                  << stats.stalls << " stalls (" << stats.stallSeconds * 1000 << " ms), " << stats.orphans << " orphans\n";
+    }
+};
@@ -0,0 +1,204 @@
+//Wide lines as quads, for drivers that cap or ignore glLineWidth
+//Segments are in pixels of the 800x800 window, every one becomes a rectangle of the given
+//width in pixels centered on it, extended by half the width past each end point
+
+#pragma once
+
+#include "glad/glad.h"
+#include "lines.h"
+#include "framebuffer.h"
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+// With GL 3.3 every segment is one instance: its end points are a per instance attribute
+// and the six corners of its two triangles are made from gl_VertexID, so a frame of
+// thousands of lines uploads four ints per line and is one draw call
+const char* thickInstancedVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec4 aSegment;
+
+uniform float halfWidth;
+
+const float along[6] = float[6](0.0, 1.0, 1.0, 0.0, 1.0, 0.0);
+const float side[6] = float[6](-1.0, -1.0, 1.0, -1.0, 1.0, 1.0);
+
+void main() {
+    vec2 a = aSegment.xy + 0.5, b = aSegment.zw + 0.5;
+    vec2 d = b - a;
+    vec2 dir = length(d) > 0.0 ? normalize(d) : vec2(1.0, 0.0);
+    vec2 normal = vec2(-dir.y, dir.x);
+    vec2 p = mix(a - dir * halfWidth, b + dir * halfWidth, along[gl_VertexID]) + normal * halfWidth * side[gl_VertexID];
+    gl_Position = vec4(p / 400.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Without it the same corners come from thickQuad on the CPU, six vertices per line. These
+// shaders stay at GLSL 1.50 so they compile on the 3.2 contexts this path is for, with aPos
+// bound to location 0 before linking.
+const char* thickVertexShaderSource = R"(
+#version 150
+in vec2 aPos;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
+)";
+
+const char* thickFragmentShaderSource = R"(
+#version 150
+uniform vec3 color;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(color, 1.0);
+}
+)";
+
+// Corners of the quad of s in window pixels, in the order of the shader: start right, end
+// right, end left, start left of the direction of the line. End points are pixel centers.
+inline void thickQuad(const Segment& s, float halfWidth, float* x, float* y){
+    float ax = s.x1 + 0.5f, ay = s.y1 + 0.5f, bx = s.x2 + 0.5f, by = s.y2 + 0.5f;
+    float dx = bx - ax, dy = by - ay;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if(length > 0.0f){
+        dx /= length;
+        dy /= length;
+    }
+    else{
+        dx = 1.0f;
+        dy = 0.0f;
+    }
+    float nx = -dy * halfWidth, ny = dx * halfWidth;
+    ax -= dx * halfWidth;
+    ay -= dy * halfWidth;
+    bx += dx * halfWidth;
+    by += dy * halfWidth;
+
+    x[0] = ax - nx; y[0] = ay - ny;
+    x[1] = bx - nx; y[1] = by - ny;
+    x[2] = bx + nx; y[2] = by + ny;
+    x[3] = ax + nx; y[3] = ay + ny;
+}
+
+// Every segment as two GL_TRIANGLES in NDC (x, y), 12 floats per segment
+inline void thickLineVertices(ArrayView<Segment> segments, float width, std::vector<float>& out){
+    out.resize(segments.size() * 12);
+    float* v = out.data();
+    for(const Segment& s : segments){
+        float x[4], y[4];
+        thickQuad(s, width * 0.5f, x, y);
+        for(int k : {0, 1, 2, 0, 2, 3}){
+            *v++ = x[k] / 400.0f - 1.0f;
+            *v++ = y[k] / 400.0f - 1.0f;
+        }
+    }
+}
+
+// Software framebuffer counterpart, each quad filled by the scanline filler
+inline size_t drawThickSegments(Framebuffer& fb, ArrayView<Segment> segments, float width, uint32_t color){
+    size_t pixels = 0;
+    for(const Segment& s : segments){
+        float x[4], y[4];
+        thickQuad(s, width * 0.5f, x, y);
+        for(int k=0;k<4;k++){
+            x[k] = x[k] / 400.0f - 1.0f;
+            y[k] = y[k] / 400.0f - 1.0f;
+        }
+        pixels += fillPolygon(fb, x, y, 4, color, fb.bounds());
+    }
+    return pixels;
+}
+
+// --thick [width] anywhere on the command line, 2 pixels by default like the glLineWidth
+// the programs ask for
+inline bool thickRequested(int argc, char** argv, float& width){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--thick") == 0){
+            width = (i + 1 < argc && std::atof(argv[i+1]) > 0.0f) ? (float)std::atof(argv[i+1]) : 2.0f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// GL objects for drawing a set of thick lines, instanced when the driver has GL 3.3 and
+// from CPU generated quads otherwise
+struct ThickLines{
+    unsigned int program = 0, VAO = 0, VBO = 0;
+    bool instanced = false;
+    int count = 0;
+    float width = 2.0f;
+
+    void create(){
+        instanced = GLAD_GL_VERSION_3_3;
+
+        unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, instanced ? &thickInstancedVertexShaderSource : &thickVertexShaderSource, NULL);
+        glCompileShader(vertexShader);
+
+        unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &thickFragmentShaderSource, NULL);
+        glCompileShader(fragmentShader);
+
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        if(!instanced){
+            glBindAttribLocation(program, 0, "aPos");
+        }
+        glLinkProgram(program);
+
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+    }
+
+    // Replaces the lines drawn, width in pixels
+    void upload(ArrayView<Segment> segments, float lineWidth){
+        width = lineWidth;
+        count = (int)segments.size();
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if(instanced){
+            static_assert(sizeof(Segment) == 4 * sizeof(int), "segments are uploaded as four ints");
+            glBufferData(GL_ARRAY_BUFFER, sizeof(Segment) * segments.size(), segments.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 4, GL_INT, GL_FALSE, sizeof(Segment), (void*)0);
+            glVertexAttribDivisor(0, 1);
+        }
+        else{
+            std::vector<float> vertices;
+            thickLineVertices(segments, width, vertices);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        }
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void draw(float r, float g, float b){
+        glUseProgram(program);
+        glUniform3f(glGetUniformLocation(program, "color"), r, g, b);
+        glBindVertexArray(VAO);
+        if(instanced){
+            glUniform1f(glGetUniformLocation(program, "halfWidth"), width * 0.5f);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+        }
+        else{
+            glDrawArrays(GL_TRIANGLES, 0, count * 6);
+        }
+        glBindVertexArray(0);
+    }
+
+    void destroy(){
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteProgram(program);
+    }
+};
@@ -0,0 +1,424 @@
+//Tile-parallel software rasterizer
+//Lines, circles and triangles are binned into 64x64 screen tiles and every tile is rasterized
+//by exactly one thread of a work-stealing pool, so no two threads write the same pixels
+
+#pragma once
+
+#include "framebuffer.h"
+#include "pool.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+const int tileSize = 64;
+
+enum PrimitiveKind{
+    LinePrimitive, CirclePrimitive, DiscPrimitive, TrianglePrimitive
+};
+
+// Triangle vertices in NDC, like the triangle programs' vertex buffers
+struct Triangle{
+    float x[3], y[3];
+};
+
+struct Primitive{
+    int kind;
+    int index;
+    uint32_t color;
+};
+
+// Lines and circles in pixels of the 800x800 window, triangles in NDC. Primitives are drawn
+// in the order they were added, later ones on top.
+struct Scene{
+    std::vector<Primitive> primitives;
+    std::vector<Segment> segments;
+    std::vector<Circle> circles;
+    std::vector<Triangle> triangles;
+
+    void addLine(const Segment& s, uint32_t color){
+        primitives.push_back({LinePrimitive, (int)segments.size(), color});
+        segments.push_back(s);
+    }
+
+    void addCircle(const Circle& c, uint32_t color, bool filled = false){
+        primitives.push_back({filled ? DiscPrimitive : CirclePrimitive, (int)circles.size(), color});
+        circles.push_back(c);
+    }
+
+    void addTriangle(const Triangle& t, uint32_t color){
+        primitives.push_back({TrianglePrimitive, (int)triangles.size(), color});
+        triangles.push_back(t);
+    }
+
+    // Empty, keeping the capacity for the next scene
+    void clear(){
+        primitives.clear();
+        segments.clear();
+        circles.clear();
+        triangles.clear();
+    }
+};
+
+// The arrays of a scene wherever they are stored, in a Scene or in a mapped scene file
+struct SceneView{
+    ArrayView<Primitive> primitives;
+    ArrayView<Segment> segments;
+    ArrayView<Circle> circles;
+    ArrayView<Triangle> triangles;
+
+    SceneView() = default;
+    SceneView(const Scene& scene)
+        : primitives(scene.primitives), segments(scene.segments), circles(scene.circles), triangles(scene.triangles){}
+};
+
+// Scenes from files and streams are checked against these before drawing. Pixel coordinates
+// and radii must fit in int16 like the compact vertex format, and triangles must reach no
+// further in NDC, so a bad element cannot make a rasterizer walk or allocate without bound.
+const int sceneCoordinateLimit = 32767;
+
+inline bool inSceneRange(int v){
+    return v >= -sceneCoordinateLimit && v <= sceneCoordinateLimit;
+}
+
+inline bool validSegment(const Segment& s){
+    return inSceneRange(s.x1) && inSceneRange(s.y1) && inSceneRange(s.x2) && inSceneRange(s.y2);
+}
+
+inline bool validCircle(const Circle& c){
+    return inSceneRange(c.xc) && inSceneRange(c.yc) && c.r >= 0 && c.r <= sceneCoordinateLimit;
+}
+
+// NaN fails both comparisons
+inline bool validTriangle(const Triangle& t){
+    const float limit = sceneCoordinateLimit / 400.0f;
+    for(int k=0;k<3;k++){
+        if(!(std::fabs(t.x[k]) <= limit && std::fabs(t.y[k]) <= limit)) return false;
+    }
+    return true;
+}
+
+inline int clampToFramebuffer(float v, int size){
+    return (int)std::min(std::max(v, 0.0f), (float)size);
+}
+
+// Framebuffer pixels primitive p of scene may write, widened by a pixel for rounding and
+// clamped to the framebuffer. Empty (x0 >= x1) when it is off screen.
+inline Rect primitiveBounds(const Framebuffer& fb, const SceneView& scene, const Primitive& p){
+    float x0, y0, x1, y1;
+    if(p.kind == LinePrimitive){
+        const Segment& s = scene.segments[p.index];
+        x0 = std::min(s.x1, s.x2); x1 = std::max(s.x1, s.x2);
+        y0 = std::min(s.y1, s.y2); y1 = std::max(s.y1, s.y2);
+    }
+    else if(p.kind == TrianglePrimitive){
+        const Triangle& t = scene.triangles[p.index];
+        x0 = (std::min({t.x[0], t.x[1], t.x[2]}) + 1.0f) * 400.0f; x1 = (std::max({t.x[0], t.x[1], t.x[2]}) + 1.0f) * 400.0f;
+        y0 = (std::min({t.y[0], t.y[1], t.y[2]}) + 1.0f) * 400.0f; y1 = (std::max({t.y[0], t.y[1], t.y[2]}) + 1.0f) * 400.0f;
+    }
+    else{
+        // The rasterizers scale the radius by the width on both axes, so on a framebuffer that
+        // is not square the circle is not the window circle scaled, bound it where it is drawn
+        const Circle& c = scene.circles[p.index];
+        float xc = (float)toFramebufferX(fb, c.xc), yc = (float)toFramebufferY(fb, c.yc), r = (float)toFramebufferX(fb, c.r);
+        return {clampToFramebuffer(xc - r - 1.0f, fb.width), clampToFramebuffer(yc - r - 1.0f, fb.height),
+                clampToFramebuffer(xc + r + 2.0f, fb.width), clampToFramebuffer(yc + r + 2.0f, fb.height)};
+    }
+    // Window pixels to framebuffer pixels
+    auto clampX = [&](float v){ return clampToFramebuffer(v * fb.width / 800.0f, fb.width); };
+    auto clampY = [&](float v){ return clampToFramebuffer(v * fb.height / 800.0f, fb.height); };
+    return {clampX(x0 - 1.0f), clampY(y0 - 1.0f), clampX(x1 + 2.0f), clampY(y1 + 2.0f)};
+}
+
+// Parts of a frame that changed. Overlapping rectangles are merged as they are added, so
+// scattered changes stay separate while a cluster becomes one rectangle; past maxRects they
+// all become their bounding box, which bounds the uploads or redraws a frame is split into.
+struct Damage{
+    static const size_t maxRects = 16;
+    std::vector<Rect> rects;
+
+    void add(Rect r){
+        if(r.x0 >= r.x1 || r.y0 >= r.y1) return;
+        for(size_t i=0;i<rects.size();){
+            const Rect& o = rects[i];
+            if(o.x0 < r.x1 && r.x0 < o.x1 && o.y0 < r.y1 && r.y0 < o.y1){
+                r = {std::min(r.x0, o.x0), std::min(r.y0, o.y0), std::max(r.x1, o.x1), std::max(r.y1, o.y1)};
+                rects[i] = rects.back();
+                rects.pop_back();
+                i = 0;
+            }
+            else{
+                i++;
+            }
+        }
+        rects.push_back(r);
+        if(rects.size() > maxRects){
+            for(const Rect& o : rects) r = {std::min(r.x0, o.x0), std::min(r.y0, o.y0), std::max(r.x1, o.x1), std::max(r.y1, o.y1)};
+            rects.assign(1, r);
+        }
+    }
+
+    bool empty() const{
+        return rects.empty();
+    }
+
+    void clear(){
+        rects.clear();
+    }
+};
+
+// One primitive after another over what is already in the framebuffer, so scenes drawn in
+// turn pile up like chunks of one larger scene
+inline void drawScene(const SceneView& scene, Framebuffer& fb){
+    for(const Primitive& p : scene.primitives){
+        if(p.kind == LinePrimitive){
+            drawSegments(fb, ArrayView<Segment>(&scene.segments[p.index], 1), p.color);
+        }
+        else if(p.kind == CirclePrimitive){
+            drawCircle(fb, scene.circles[p.index], p.color);
+        }
+        else if(p.kind == DiscPrimitive){
+            fillCircle(fb, scene.circles[p.index], p.color);
+        }
+        else{
+            const Triangle& t = scene.triangles[p.index];
+            fillTriangle(fb, t.x[0], t.y[0], t.x[1], t.y[1], t.x[2], t.y[2], p.color);
+        }
+    }
+}
+
+// The whole scene over a cleared framebuffer, the reference for the tiled path
+inline void renderScene(const SceneView& scene, Framebuffer& fb, uint32_t background){
+    fb.clear(background);
+    drawScene(scene, fb);
+}
+
+struct TileTiming{
+    double seconds;
+    unsigned worker;
+    size_t primitives;
+};
+
+// Holds the pool and the per frame buffers, which keep their capacity between frames
+struct TileRenderer{
+    WorkStealingPool pool;
+    int tilesX = 0, tilesY = 0;
+
+    // The scene's lines and circles scaled to framebuffer pixels
+    std::vector<Segment> segments;
+    std::vector<Circle> circles;
+
+    // Spans of every disc by row, primitive i owns [first[i], first[i + 1])
+    std::vector<Run> runs;
+    std::vector<size_t> first;
+
+    // bins[chunk][tile] lists the primitives of that chunk touching the tile. Chunks are
+    // consecutive ranges of primitives binned in parallel, so walking the chunks in order
+    // keeps the submission order.
+    std::vector<std::vector<std::vector<uint32_t>>> bins;
+
+    // Tiles redrawn by the last frame
+    std::vector<char> damaged;
+
+    // Rasterization time of every tile in the last frame, zero for tiles it did not redraw
+    std::vector<TileTiming> timings;
+
+    explicit TileRenderer(unsigned threads = 0) : pool(threads){}
+
+    Rect tileRect(const Framebuffer& fb, int tile) const{
+        int tx = tile % tilesX, ty = tile / tilesX;
+        return {tx * tileSize, ty * tileSize, std::min((tx + 1) * tileSize, fb.width), std::min((ty + 1) * tileSize, fb.height)};
+    }
+
+    void render(const SceneView& scene, Framebuffer& fb, uint32_t background){
+        Rect all = fb.bounds();
+        render(scene, fb, background, ArrayView<Rect>(&all, 1));
+    }
+
+    // Redraws only the tiles overlapping damage, the rest of fb keeps its pixels. Those must
+    // be the scene's, e.g. the previous frame when only the primitives inside damage changed.
+    void render(const SceneView& scene, Framebuffer& fb, uint32_t background, ArrayView<Rect> damage){
+        tilesX = (fb.width + tileSize - 1) / tileSize;
+        tilesY = (fb.height + tileSize - 1) / tileSize;
+        int tiles = tilesX * tilesY;
+        size_t n = scene.primitives.size();
+
+        damaged.assign(tiles, 0);
+        for(const Rect& r : damage){
+            if(r.x0 >= r.x1 || r.y0 >= r.y1) continue;
+            forTiles(r.x0, r.y0, r.x1 - 1, r.y1 - 1, [&](int tx, int ty){ damaged[ty * tilesX + tx] = 1; });
+        }
+
+        segments.resize(scene.segments.size());
+        for(size_t i=0;i<segments.size();i++) segments[i] = toFramebuffer(fb, scene.segments[i]);
+        circles.resize(scene.circles.size());
+        for(size_t i=0;i<circles.size();i++){
+            const Circle& c = scene.circles[i];
+            circles[i] = {toFramebufferX(fb, c.xc), toFramebufferY(fb, c.yc), toFramebufferX(fb, c.r)};
+        }
+
+        first.resize(n + 1);
+        size_t total = 0;
+        for(size_t i=0;i<n;i++){
+            first[i] = total;
+            const Primitive& p = scene.primitives[i];
+            if(p.kind == DiscPrimitive) total += circleSpanCount(circles[p.index].r);
+        }
+        first[n] = total;
+        runs.resize(total);
+
+        // Rasterize the discs into spans and bin everything, one chunk per task
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(n, pool.size() * 4));
+        bins.resize(chunks);
+        for(auto& chunk : bins){
+            chunk.resize(tiles);
+            for(auto& bin : chunk) bin.clear();
+        }
+        pool.run(chunks, [&](size_t chunk, unsigned){
+            for(size_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++){
+                binPrimitive(scene, fb, i, bins[chunk]);
+            }
+        });
+
+        // Busiest tiles first so the long ones start early and the short ones fill the gaps
+        std::vector<size_t> order, cost(tiles, 0);
+        for(int t=0;t<tiles;t++){
+            if(!damaged[t]) continue;
+            order.push_back(t);
+            for(auto& chunk : bins) cost[t] += chunk[t].size();
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return cost[a] > cost[b]; });
+
+        timings.assign(tiles, {0.0, 0, 0});
+        pool.run(order, [&](size_t tile, unsigned worker){
+            auto start = std::chrono::steady_clock::now();
+            Rect clip = tileRect(fb, (int)tile);
+            fb.fillRect(clip, background);
+            for(auto& chunk : bins){
+                for(uint32_t i : chunk[tile]) drawPrimitive(scene, fb, i, clip);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            timings[tile] = {seconds, worker, cost[tile]};
+        });
+    }
+
+    // Tiles overlapping the pixel range [x0, x1] x [y0, y1], clamped to the grid
+    template<typename Visit>
+    void forTiles(float x0, float y0, float x1, float y1, Visit visit) const{
+        int tx0 = std::max(0, (int)std::floor(x0 / tileSize)), tx1 = std::min(tilesX - 1, (int)std::floor(x1 / tileSize));
+        int ty0 = std::max(0, (int)std::floor(y0 / tileSize)), ty1 = std::min(tilesY - 1, (int)std::floor(y1 / tileSize));
+        for(int ty=ty0;ty<=ty1;ty++){
+            for(int tx=tx0;tx<=tx1;tx++) visit(tx, ty);
+        }
+    }
+
+    void binPrimitive(const SceneView& scene, const Framebuffer& fb, size_t i, std::vector<std::vector<uint32_t>>& bin){
+        const Primitive& p = scene.primitives[i];
+        auto add = [&](int tx, int ty){
+            if(damaged[ty * tilesX + tx]) bin[ty * tilesX + tx].push_back((uint32_t)i);
+        };
+
+        if(p.kind == LinePrimitive){
+            const Segment& s = segments[p.index];
+
+            // Walk the tile stripes along the major axis; within a stripe the line stays
+            // within half a pixel of the exact line between the stripe's ends
+            bool xMajor = std::abs(s.x2 - s.x1) >= std::abs(s.y2 - s.y1);
+            int a1 = xMajor ? s.x1 : s.y1, a2 = xMajor ? s.x2 : s.y2;
+            int b1 = xMajor ? s.y1 : s.x1, b2 = xMajor ? s.y2 : s.x2;
+            int lo = std::min(a1, a2), hi = std::max(a1, a2);
+            int stripes = xMajor ? tilesX : tilesY;
+            for(int k=std::max(0, lo / tileSize);k<=std::min(stripes - 1, hi / tileSize);k++){
+                int s0 = std::max(lo, k * tileSize), s1 = std::min(hi, (k + 1) * tileSize - 1);
+                float m0 = b1, m1 = b1;
+                if(a2 != a1){
+                    m0 = b1 + (float)(s0 - a1) * (b2 - b1) / (a2 - a1);
+                    m1 = b1 + (float)(s1 - a1) * (b2 - b1) / (a2 - a1);
+                }
+                float minor0 = std::min(m0, m1) - 1.0f, minor1 = std::max(m0, m1) + 1.0f;
+                if(xMajor) forTiles(s0, minor0, s1, minor1, add);
+                else forTiles(minor0, s0, minor1, s1, add);
+            }
+        }
+        else if(p.kind == CirclePrimitive || p.kind == DiscPrimitive){
+            const Circle& c = circles[p.index];
+            bool touched = false;
+            forTiles(c.xc - c.r, c.yc - c.r, c.xc + c.r, c.yc + c.r, [&](int tx, int ty){ touched |= damaged[ty * tilesX + tx] != 0; });
+            if(!touched) return;
+            if(p.kind == DiscPrimitive){
+                // Stored by row, bottom up, so a tile can index its rows directly
+                Run* out = runs.data() + first[i];
+                Run* end = midpointCircleSpans(c.xc, c.yc, c.r, out);
+                for(Run* span=out;span!=end;){
+                    Run* slot = out + (span->y - (c.yc - c.r));
+                    if(slot == span) span++;
+                    else std::swap(*span, *slot);
+                }
+            }
+
+            // Skip the tiles of the bounding box the circle misses: outside it, or for an
+            // outline inside it
+            forTiles(c.xc - c.r, c.yc - c.r, c.xc + c.r, c.yc + c.r, [&](int tx, int ty){
+                float x0 = tx * tileSize - c.xc, x1 = (tx + 1) * tileSize - 1 - c.xc;
+                float y0 = ty * tileSize - c.yc, y1 = (ty + 1) * tileSize - 1 - c.yc;
+                float nx = std::max({x0, 0.0f, -x1}), ny = std::max({y0, 0.0f, -y1});
+                float fx = std::max(std::abs(x0), std::abs(x1)), fy = std::max(std::abs(y0), std::abs(y1));
+                float r1 = c.r + 1.0f, r0 = c.r - 1.0f;
+                if(nx * nx + ny * ny > r1 * r1) return;
+                if(p.kind == CirclePrimitive && r0 > 0.0f && fx * fx + fy * fy < r0 * r0) return;
+                add(tx, ty);
+            });
+        }
+        else{
+            const Triangle& t = scene.triangles[p.index];
+            float x[3], y[3];
+            for(int k=0;k<3;k++){
+                x[k] = (t.x[k] + 1.0f) * 0.5f * fb.width;
+                y[k] = (t.y[k] + 1.0f) * 0.5f * fb.height;
+            }
+            float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+            if(area == 0.0f) return;
+            float orient = area > 0.0f ? 1.0f : -1.0f;
+
+            // Skip tiles entirely on the outside of one edge
+            forTiles(std::min({x[0], x[1], x[2]}), std::min({y[0], y[1], y[2]}),
+                     std::max({x[0], x[1], x[2]}), std::max({y[0], y[1], y[2]}), [&](int tx, int ty){
+                float cx[2] = {(float)tx * tileSize, (float)(tx + 1) * tileSize};
+                float cy[2] = {(float)ty * tileSize, (float)(ty + 1) * tileSize};
+                for(int k=0;k<3;k++){
+                    int n = (k + 1) % 3;
+                    float ex = x[n] - x[k], ey = y[n] - y[k];
+                    bool outside = true;
+                    for(int c=0;c<4 && outside;c++){
+                        float w = ex * (cy[c / 2] - y[k]) - ey * (cx[c % 2] - x[k]);
+                        outside = w * orient < 0.0f;
+                    }
+                    if(outside) return;
+                }
+                add(tx, ty);
+            });
+        }
+    }
+
+    void drawPrimitive(const SceneView& scene, Framebuffer& fb, size_t i, const Rect& clip){
+        const Primitive& p = scene.primitives[i];
+
+        if(p.kind == LinePrimitive){
+            drawSegmentClipped(fb, segments[p.index], p.color, clip);
+        }
+        else if(p.kind == DiscPrimitive){
+            const Circle& c = circles[p.index];
+            int y0 = std::max(clip.y0, c.yc - c.r), y1 = std::min(clip.y1 - 1, c.yc + c.r);
+            for(int y=y0;y<=y1;y++){
+                fb.fillRun(runs[first[i] + (y - (c.yc - c.r))], p.color, clip);
+            }
+        }
+        else if(p.kind == CirclePrimitive){
+            drawCircleClipped(fb, circles[p.index], p.color, clip);
+        }
+        else{
+            const Triangle& t = scene.triangles[p.index];
+            fillTriangle(fb, t.x[0], t.y[0], t.x[1], t.y[1], t.x[2], t.y[2], p.color, clip);
+        }
+    }
+};
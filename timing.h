@@ -0,0 +1,288 @@
+//Per frame timing of the render loops
+//Built with -DFRAME_TIMING, FrameTimer takes CPU timestamps around named sections of a frame
+//(generation, upload, swap) and GL timestamp queries around the draw calls, keeps the last
+//timingFrames frames in a ring and on exit prints p50/p95/p99 of each and writes them as CSV
+//or Chrome trace JSON (--timing frames.csv|frames.json). Without the define FrameTimer is an
+//empty struct with empty inline methods, so the calls in the loops compile to nothing.
+
+#pragma once
+
+#include "glad/glad.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+const int timingSections = 8;
+const int timingFrames = 1024;
+// Frames a query waits before its result is read, by then the GPU has long finished it and
+// reading it does not stall the frame
+const int timingQueryLag = 4;
+
+// --timing [frames.csv|frames.json] anywhere on the command line
+inline bool timingRequested(int argc, char** argv, std::string& output){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--timing") == 0){
+            output = (i + 1 < argc && argv[i+1][0] != '-') ? argv[i+1] : "";
+            return true;
+        }
+    }
+    return false;
+}
+
+#if defined(FRAME_TIMING)
+
+// One frame in seconds since FrameTimer::create(). Bit k of cpuUsed / gpuUsed says section k
+// ran in the frame; GPU times are moved onto the CPU clock.
+struct FrameRecord{
+    uint64_t frame = 0;
+    double start = 0.0, end = 0.0;
+    uint32_t cpuUsed = 0, gpuUsed = 0;
+    double cpu[timingSections][2];
+    double gpu[timingSections][2];
+};
+
+struct FrameTimer{
+    std::vector<const char*> names;
+    std::vector<FrameRecord> ring;
+    uint64_t frames = 0;
+    std::chrono::steady_clock::time_point origin;
+    std::string output;
+
+    bool gpuTiming = false;
+    double gpuOffset = 0.0;
+    unsigned queries[timingQueryLag][timingSections][2] = {};
+    uint32_t pending[timingQueryLag] = {};
+    uint64_t pendingFrame[timingQueryLag] = {};
+
+    // Needs the GL context current. GL 3.3 or ARB_timer_query adds the GPU times.
+    void create(int argc, char** argv){
+        timingRequested(argc, argv, output);
+        origin = std::chrono::steady_clock::now();
+        ring.resize(timingFrames);
+        gpuTiming = GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+        if(gpuTiming){
+            glGenQueries(timingQueryLag * timingSections * 2, &queries[0][0][0]);
+            GLint64 gpuNow = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            gpuOffset = now() - gpuNow * 1e-9;
+        }
+    }
+
+    double now() const{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    FrameRecord& current(){
+        return ring[frames % timingFrames];
+    }
+
+    int section(const char* name){
+        for(size_t i=0;i<names.size();i++){
+            if(names[i] == name || std::strcmp(names[i], name) == 0) return (int)i;
+        }
+        if(names.size() == timingSections) return -1;
+        names.push_back(name);
+        return (int)names.size() - 1;
+    }
+
+    void beginFrame(){
+        // This slot's queries belong to the frame timingQueryLag frames back
+        resolve(frames % timingQueryLag);
+        FrameRecord& r = current();
+        r = FrameRecord();
+        r.frame = frames;
+        r.start = now();
+    }
+
+    void endFrame(){
+        current().end = now();
+        frames++;
+    }
+
+    // A section of the frame measured on the CPU. A section timed twice in one frame spans from
+    // its first begin to its last end.
+    void beginCpu(const char* name){
+        begin(section(name), false);
+    }
+
+    void endCpu(const char* name){
+        end(section(name), false);
+    }
+
+    // CPU time of the calls in between and GPU time of the commands they issue
+    void beginGpu(const char* name){
+        begin(section(name), gpuTiming);
+    }
+
+    void endGpu(const char* name){
+        end(section(name), gpuTiming);
+    }
+
+    void begin(int s, bool gpu){
+        if(s < 0) return;
+        FrameRecord& r = current();
+        bool first = !(r.cpuUsed >> s & 1);
+        if(first) r.cpu[s][0] = now();
+        r.cpuUsed |= 1u << s;
+        if(gpu && first) glQueryCounter(queries[frames % timingQueryLag][s][0], GL_TIMESTAMP);
+    }
+
+    void end(int s, bool gpu){
+        if(s < 0) return;
+        current().cpu[s][1] = now();
+        if(gpu){
+            int slot = frames % timingQueryLag;
+            glQueryCounter(queries[slot][s][1], GL_TIMESTAMP);
+            pending[slot] |= 1u << s;
+            pendingFrame[slot] = frames;
+        }
+    }
+
+    // Reads the queries of one slot into its frame's record, if the ring still holds it
+    void resolve(int slot){
+        if(!pending[slot]) return;
+        FrameRecord& r = ring[pendingFrame[slot] % timingFrames];
+        for(int s=0;s<timingSections;s++){
+            if(!(pending[slot] >> s & 1)) continue;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[slot][s][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[slot][s][1], GL_QUERY_RESULT, &end);
+            if(r.frame != pendingFrame[slot]) continue;
+            r.gpu[s][0] = begin * 1e-9 + gpuOffset;
+            r.gpu[s][1] = end * 1e-9 + gpuOffset;
+            r.gpuUsed |= 1u << s;
+        }
+        pending[slot] = 0;
+    }
+
+    // Frames kept in the ring, oldest first, with every query read
+    std::vector<const FrameRecord*> recorded(){
+        for(int slot=0;slot<timingQueryLag;slot++) resolve(slot);
+        std::vector<const FrameRecord*> out;
+        uint64_t first = frames > (uint64_t)timingFrames ? frames - timingFrames : 0;
+        for(uint64_t f=first;f<frames;f++) out.push_back(&ring[f % timingFrames]);
+        return out;
+    }
+
+    static double percentile(std::vector<double> v, double p){
+        if(v.empty()) return 0.0;
+        std::sort(v.begin(), v.end());
+        size_t rank = (size_t)std::ceil(p * v.size());
+        return v[std::min(v.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    // Summary of the recorded frames, then the file if --timing named one. Call before the
+    // GL context goes away.
+    void report(){
+        std::vector<const FrameRecord*> records = recorded();
+        if(records.empty()) return;
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-20s %9s %9s %9s %9s %9s", "", "mean", "p50", "p95", "p99", "max");
+        std::cout << frames << " frames timed, the last " << records.size() << " in ms:\n" << line << "\n";
+        auto row = [&](const std::string& label, const std::vector<double>& ms){
+            if(ms.empty()) return;
+            double sum = 0.0;
+            for(double v : ms) sum += v;
+            std::snprintf(line, sizeof(line), "%-20s %9.3f %9.3f %9.3f %9.3f %9.3f", label.c_str(), sum / ms.size(),
+                          percentile(ms, 0.5), percentile(ms, 0.95), percentile(ms, 0.99), *std::max_element(ms.begin(), ms.end()));
+            std::cout << line << "\n";
+        };
+
+        std::vector<double> ms;
+        for(const FrameRecord* r : records) ms.push_back((r->end - r->start) * 1000.0);
+        row("frame", ms);
+        for(size_t s=0;s<names.size();s++){
+            ms.clear();
+            for(const FrameRecord* r : records) if(r->cpuUsed >> s & 1) ms.push_back((r->cpu[s][1] - r->cpu[s][0]) * 1000.0);
+            row(std::string(names[s]) + " cpu", ms);
+            ms.clear();
+            for(const FrameRecord* r : records) if(r->gpuUsed >> s & 1) ms.push_back((r->gpu[s][1] - r->gpu[s][0]) * 1000.0);
+            row(std::string(names[s]) + " gpu", ms);
+        }
+
+        if(output.empty()) return;
+        bool json = output.size() > 5 && output.compare(output.size() - 5, 5, ".json") == 0;
+        std::ofstream out(output);
+        if(json) writeTrace(out, records);
+        else writeCSV(out, records);
+        if(!out) std::cerr << "could not write " << output << "\n";
+    }
+
+    // One row per frame, times in ms, empty where a section did not run
+    void writeCSV(std::ostream& out, const std::vector<const FrameRecord*>& records) const{
+        out << "frame,start_ms,frame_ms";
+        for(const char* name : names) out << "," << name << "_cpu_ms," << name << "_gpu_ms";
+        out << "\n";
+        char value[32];
+        auto put = [&](bool used, double seconds){
+            out << ",";
+            if(!used) return;
+            std::snprintf(value, sizeof(value), "%.4f", seconds * 1000.0);
+            out << value;
+        };
+        for(const FrameRecord* r : records){
+            out << r->frame;
+            put(true, r->start);
+            put(true, r->end - r->start);
+            for(size_t s=0;s<names.size();s++){
+                put(r->cpuUsed >> s & 1, r->cpu[s][1] - r->cpu[s][0]);
+                put(r->gpuUsed >> s & 1, r->gpu[s][1] - r->gpu[s][0]);
+            }
+            out << "\n";
+        }
+    }
+
+    // Complete events for chrome://tracing or Perfetto, frames and CPU sections on one track
+    // and GPU sections on another, in microseconds
+    void writeTrace(std::ostream& out, const std::vector<const FrameRecord*>& records) const{
+        out << "{\"traceEvents\":[\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        char event[256];
+        auto put = [&](const char* name, int tid, double begin, double end, uint64_t frame){
+            std::snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"args\":{\"frame\":%llu}}", name, tid, begin * 1e6, (end - begin) * 1e6, (unsigned long long)frame);
+            out << event;
+        };
+        for(const FrameRecord* r : records){
+            put("frame", 1, r->start, r->end, r->frame);
+            for(size_t s=0;s<names.size();s++){
+                if(r->cpuUsed >> s & 1) put(names[s], 1, r->cpu[s][0], r->cpu[s][1], r->frame);
+                if(r->gpuUsed >> s & 1) put(names[s], 2, r->gpu[s][0], r->gpu[s][1], r->frame);
+            }
+        }
+        out << "\n]}\n";
+    }
+
+    void destroy(){
+        if(gpuTiming) glDeleteQueries(timingQueryLag * timingSections * 2, &queries[0][0][0]);
+    }
+};
+
+#else
+
+// Same calls, no code
+struct FrameTimer{
+    void create(int argc, char** argv){
+        std::string output;
+        if(timingRequested(argc, argv, output)) std::cerr << "--timing needs a build with -DFRAME_TIMING\n";
+    }
+    void beginFrame(){}
+    void endFrame(){}
+    void beginCpu(const char*){}
+    void endCpu(const char*){}
+    void beginGpu(const char*){}
+    void endGpu(const char*){}
+    void report(){}
+    void destroy(){}
+};
+
+#endif
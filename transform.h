@@ -0,0 +1,315 @@
+//2D transformations shared by the transformation programs
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include "profile.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+struct Point{
+    float x,y;
+};
+
+inline Point translate(Point p, float xf, float yf){
+    return {p.x + xf, p.y + yf};
+}
+
+inline Point scaling(Point p, float sx, float sy, float xf, float yf){
+    float scaled_x = (p.x - xf)*sx + xf;
+    float scaled_y = (p.y - yf)*sy + yf;
+
+    return {scaled_x, scaled_y};
+}
+
+// translate, scaling and rotateFixed are a few instructions per point, as cheap as a profiling
+// zone itself, so their zones go around the loops calling them
+
+inline Point rotateFixed(Point p, float angle, float xf, float yf){
+    float rad = angle * M_PI / 180.0;
+
+    float x_translated = p.x - xf;
+    float y_translated = p.y - yf;
+
+    float x_rotated = x_translated * cos(rad) - y_translated * sin(rad);
+    float y_rotated = x_translated * sin(rad) + y_translated * cos(rad);
+
+    return {x_rotated + xf, y_rotated + yf};
+}
+
+// 3x3 affine matrix with the constant last row (0 0 1) left out:
+// x' = a*x + b*y + tx
+// y' = c*x + d*y + ty
+struct Affine{
+    float a = 1.0f, b = 0.0f, tx = 0.0f;
+    float c = 0.0f, d = 1.0f, ty = 0.0f;
+};
+
+// Composition, (m * n) applies n first and then m. A chain of operations folds into one
+// matrix, e.g. affineRotate(...) * affineScale(...) * affineTranslate(...) translates first.
+inline Affine operator*(const Affine& m, const Affine& n){
+    Affine r;
+    r.a = m.a * n.a + m.b * n.c;
+    r.b = m.a * n.b + m.b * n.d;
+    r.tx = m.a * n.tx + m.b * n.ty + m.tx;
+    r.c = m.c * n.a + m.d * n.c;
+    r.d = m.c * n.b + m.d * n.d;
+    r.ty = m.c * n.tx + m.d * n.ty + m.ty;
+    return r;
+}
+
+inline Affine affineTranslate(float xf, float yf){
+    Affine m;
+    m.tx = xf;
+    m.ty = yf;
+    return m;
+}
+
+// Same as scaling(): scale by (sx, sy) about the fixed point (xf, yf)
+inline Affine affineScale(float sx, float sy, float xf, float yf){
+    Affine m;
+    m.a = sx;
+    m.d = sy;
+    m.tx = xf - sx * xf;
+    m.ty = yf - sy * yf;
+    return m;
+}
+
+// Rotation about the pivot (xf, yf) from its cosine and sine
+inline Affine affineRotation(float cs, float sn, float xf, float yf){
+    Affine m;
+    m.a = cs;
+    m.b = -sn;
+    m.c = sn;
+    m.d = cs;
+    m.tx = xf - cs * xf + sn * yf;
+    m.ty = yf - sn * xf - cs * yf;
+    return m;
+}
+
+// Same as rotateFixed(): rotate by angle degrees about the pivot (xf, yf)
+inline Affine affineRotate(float angle, float xf, float yf){
+    float rad = angle * (float)M_PI / 180.0f;
+    return affineRotation(std::cos(rad), std::sin(rad), xf, yf);
+}
+
+// Angle advancing by a fixed step every animation frame. advance() rotates (cs, sn) by the
+// step with one complex multiply instead of new sin/cos calls, and renormalizes so rounding
+// cannot shrink or grow the vector over many frames.
+struct RotationStepper{
+    float cs = 1.0f, sn = 0.0f;
+    float stepCs = 1.0f, stepSn = 0.0f;
+
+    RotationStepper(float angle, float step){
+        float rad = angle * (float)M_PI / 180.0f, stepRad = step * (float)M_PI / 180.0f;
+        cs = std::cos(rad);
+        sn = std::sin(rad);
+        stepCs = std::cos(stepRad);
+        stepSn = std::sin(stepRad);
+    }
+
+    void advance(){
+        float c = cs * stepCs - sn * stepSn;
+        float s = sn * stepCs + cs * stepSn;
+        float scale = 1.5f - 0.5f * (c * c + s * s);
+        cs = c * scale;
+        sn = s * scale;
+    }
+
+    Affine about(float xf, float yf) const {
+        return affineRotation(cs, sn, xf, yf);
+    }
+};
+
+inline Point applyAffine(const Affine& m, Point p){
+    return {m.a * p.x + m.b * p.y + m.tx, m.c * p.x + m.d * p.y + m.ty};
+}
+
+// Points as structure of arrays, so the kernel below loads whole registers of x and y
+struct PointBuffer{
+    std::vector<float> x, y;
+
+    size_t size() const { return x.size(); }
+};
+
+inline PointBuffer toPointBuffer(const std::vector<Point>& points){
+    PointBuffer buffer;
+    buffer.x.resize(points.size());
+    buffer.y.resize(points.size());
+    for(size_t i=0;i<points.size();i++){
+        buffer.x[i] = points[i].x;
+        buffer.y[i] = points[i].y;
+    }
+    return buffer;
+}
+
+// Applies m to n points. The output may be the input itself (in place) or caller-owned
+// arrays; every element is loaded before its result is stored, so either is safe.
+inline void applyAffine(const Affine& m, const float* x, const float* y, float* outX, float* outY, size_t n){
+    PROFILE_ZONE(zone, "applyAffine");
+    zone.points(n);
+    size_t i = 0;
+
+#if defined(__AVX__)
+    __m256 a = _mm256_set1_ps(m.a), b = _mm256_set1_ps(m.b), tx = _mm256_set1_ps(m.tx);
+    __m256 c = _mm256_set1_ps(m.c), d = _mm256_set1_ps(m.d), ty = _mm256_set1_ps(m.ty);
+    for(;i+8<=n;i+=8){
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, px), _mm256_mul_ps(b, py)), tx));
+        _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c, px), _mm256_mul_ps(d, py)), ty));
+    }
+#elif defined(__SSE2__)
+    __m128 a = _mm_set1_ps(m.a), b = _mm_set1_ps(m.b), tx = _mm_set1_ps(m.tx);
+    __m128 c = _mm_set1_ps(m.c), d = _mm_set1_ps(m.d), ty = _mm_set1_ps(m.ty);
+    for(;i+4<=n;i+=4){
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px), _mm_mul_ps(b, py)), tx));
+        _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c, px), _mm_mul_ps(d, py)), ty));
+    }
+#endif
+
+    for(;i<n;i++){
+        float px = x[i], py = y[i];
+        outX[i] = m.a * px + m.b * py + m.tx;
+        outY[i] = m.c * px + m.d * py + m.ty;
+    }
+}
+
+inline void applyAffine(const Affine& m, PointBuffer& points){
+    applyAffine(m, points.x.data(), points.y.data(), points.x.data(), points.y.data(), points.size());
+}
+
+inline void applyAffine(const Affine& m, const PointBuffer& points, PointBuffer& out){
+    out.x.resize(points.size());
+    out.y.resize(points.size());
+    applyAffine(m, points.x.data(), points.y.data(), out.x.data(), out.y.data(), points.size());
+}
+
+// sin and cos of an angle in degrees for when every point has its own angle. The angle is
+// reduced in degrees to r = angle - 90q with |r| <= 45, which is exact, and r is evaluated
+// with the Cephes single precision minimax polynomials on [-pi/4, pi/4]. Measured absolute
+// error against double precision is below 1e-7 for |angle| < 1e6 degrees. The angle must
+// fit the int32 quadrant count, |angle| < 1.9e11.
+const float sinC1 = -1.6666654611e-1f, sinC2 = 8.3321608736e-3f, sinC3 = -1.9515295891e-4f;
+const float cosC1 = 4.166664568298827e-2f, cosC2 = -1.388731625493765e-3f, cosC3 = 2.443315711809948e-5f;
+
+inline void sincosDeg(float angle, float& s, float& c){
+    float q = std::nearbyint(angle * (1.0f / 90.0f));
+    float x = (angle - q * 90.0f) * ((float)M_PI / 180.0f);
+    float x2 = x * x;
+
+    float ps = x + x * x2 * (sinC1 + x2 * (sinC2 + x2 * sinC3));
+    float pc = 1.0f - 0.5f * x2 + x2 * x2 * (cosC1 + x2 * (cosC2 + x2 * cosC3));
+
+    int quadrant = (int)q & 3;
+    float sinBase = (quadrant & 1) ? pc : ps;
+    float cosBase = (quadrant & 1) ? ps : pc;
+    s = (quadrant & 2) ? -sinBase : sinBase;
+    c = ((quadrant + 1) & 2) ? -cosBase : cosBase;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+typedef __m256 floatv;
+typedef __m256i intv;
+const int sincosLanes = 8;
+inline floatv vset(float v){ return _mm256_set1_ps(v); }
+inline floatv vadd(floatv a, floatv b){ return _mm256_add_ps(a, b); }
+inline floatv vsub(floatv a, floatv b){ return _mm256_sub_ps(a, b); }
+inline floatv vmul(floatv a, floatv b){ return _mm256_mul_ps(a, b); }
+inline floatv vselect(floatv mask, floatv a, floatv b){ return _mm256_blendv_ps(b, a, mask); }
+inline intv vround(floatv a){ return _mm256_cvtps_epi32(a); }
+inline floatv vtofloat(intv a){ return _mm256_cvtepi32_ps(a); }
+// All bits set in the lanes where (q & bit) != 0
+inline floatv vbit(intv q, int bit){
+    intv b = _mm256_set1_epi32(bit);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, b), b));
+}
+inline intv vaddint(intv a, int b){ return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+inline floatv vxor(floatv a, floatv b){ return _mm256_xor_ps(a, b); }
+inline floatv vand(floatv a, floatv b){ return _mm256_and_ps(a, b); }
+inline floatv vload(const float* p){ return _mm256_loadu_ps(p); }
+inline void vstore(float* p, floatv a){ _mm256_storeu_ps(p, a); }
+#else
+typedef __m128 floatv;
+typedef __m128i intv;
+const int sincosLanes = 4;
+inline floatv vset(float v){ return _mm_set1_ps(v); }
+inline floatv vadd(floatv a, floatv b){ return _mm_add_ps(a, b); }
+inline floatv vsub(floatv a, floatv b){ return _mm_sub_ps(a, b); }
+inline floatv vmul(floatv a, floatv b){ return _mm_mul_ps(a, b); }
+inline floatv vselect(floatv mask, floatv a, floatv b){ return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline intv vround(floatv a){ return _mm_cvtps_epi32(a); }
+inline floatv vtofloat(intv a){ return _mm_cvtepi32_ps(a); }
+inline floatv vbit(intv q, int bit){
+    intv b = _mm_set1_epi32(bit);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, b), b));
+}
+inline intv vaddint(intv a, int b){ return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+inline floatv vxor(floatv a, floatv b){ return _mm_xor_ps(a, b); }
+inline floatv vand(floatv a, floatv b){ return _mm_and_ps(a, b); }
+inline floatv vload(const float* p){ return _mm_loadu_ps(p); }
+inline void vstore(float* p, floatv a){ _mm_storeu_ps(p, a); }
+#endif
+
+// sincosDeg on a whole register of angles, same reduction and polynomials as the scalar version
+inline void sincosDeg(floatv angle, floatv& s, floatv& c){
+    intv qi = vround(vmul(angle, vset(1.0f / 90.0f)));
+    floatv q = vtofloat(qi);
+    floatv x = vmul(vsub(angle, vmul(q, vset(90.0f))), vset((float)M_PI / 180.0f));
+    floatv x2 = vmul(x, x);
+
+    floatv ps = vadd(x, vmul(vmul(x, x2), vadd(vset(sinC1), vmul(x2, vadd(vset(sinC2), vmul(x2, vset(sinC3)))))));
+    floatv pc = vadd(vsub(vset(1.0f), vmul(vset(0.5f), x2)),
+                     vmul(vmul(x2, x2), vadd(vset(cosC1), vmul(x2, vadd(vset(cosC2), vmul(x2, vset(cosC3)))))));
+
+    floatv odd = vbit(qi, 1);
+    floatv signBit = vset(-0.0f);
+    s = vxor(vselect(odd, pc, ps), vand(vbit(qi, 2), signBit));
+    c = vxor(vselect(odd, ps, pc), vand(vbit(vaddint(qi, 1), 2), signBit));
+}
+#endif
+
+// sin and cos of n angles in degrees
+inline void sincosDeg(const float* angles, float* s, float* c, size_t n){
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for(;i+sincosLanes<=n;i+=sincosLanes){
+        floatv vs, vc;
+        sincosDeg(vload(angles + i), vs, vc);
+        vstore(s + i, vs);
+        vstore(c + i, vc);
+    }
+#endif
+    for(;i<n;i++){
+        sincosDeg(angles[i], s[i], c[i]);
+    }
+}
+
+// Rotates every point by its own angle (degrees) about the pivot (xf, yf), in place
+inline void rotatePoints(PointBuffer& points, const float* angles, float xf, float yf){
+    PROFILE_ZONE(zone, "rotatePoints");
+    zone.points(points.size());
+    const size_t block = 256;
+    float s[block], c[block];
+
+    for(size_t start=0;start<points.size();start+=block){
+        size_t n = std::min(block, points.size() - start);
+        sincosDeg(angles + start, s, c, n);
+
+        float* x = points.x.data() + start;
+        float* y = points.y.data() + start;
+        for(size_t i=0;i<n;i++){
+            float dx = x[i] - xf, dy = y[i] - yf;
+            x[i] = dx * c[i] - dy * s[i] + xf;
+            y[i] = dx * s[i] + dy * c[i] + yf;
+        }
+    }
+}
@@ -6,49 +6,57 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstring>
+#include "transform.h"
+#include "instancing.h"
+#include "compact.h"
+#include "redraw.h"
+#include "timing.h"
 
 
-struct Point{
-    float x,y;
-};  
-
-Point translate(Point p, float xf, float yf){
-    return {p.x + xf, p.y + yf};
-}
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
-// Shader sources
-const char* vertexShaderSource = R"(
-#version 330 core
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec3 aColor;
-
-out vec3 vertexColor;
+int main(int argc, char** argv){
+    // --check renders one frame in a hidden window and compares it with the CPU transform
+    bool check = argc > 1 && std::strcmp(argv[1], "--check") == 0;
+    // --clip transforms and clips the instances on the CPU and uploads only what is on screen
+    bool clipMode = argc > 1 && std::strcmp(argv[1], "--clip") == 0;
+    // --compact with --clip uploads 8 byte vertices, 2.14 fixed point positions and an RGBA8
+    // color, instead of five floats
+    bool compact = clipMode && compactRequested(argc, argv);
 
-void main() {
-    gl_Position = vec4(aPos, 0.0, 1.0);
-    vertexColor = aColor;
-}
-)";
+    std::vector<Point> og_triangle = {
+        {-0.5f, -0.5f},
+        {0.5f, -0.5f},
+        {0.0f, 0.5f}
+    };
 
-const char* fragmentShaderSource = R"(
-#version 330 core
-in vec3 vertexColor;
-out vec4 FragColor;
+    float xf = 0.2f, yf = 0.0f;
 
-void main() {
-    FragColor = vec4(vertexColor, 1.0);
-}
-)";
+    //Instance 0: original triangle -> white
+    //Instance 1: translated triangle -> green
+    std::vector<Affine> transforms = {Affine(), affineTranslate(xf, yf)};
+    std::vector<Color> colors = {{1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 0.0f}};
+
+    // --headless [image.ppm|image.png] transforms the triangles on the CPU and fills them in a
+    // software framebuffer
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            return fillInstances(fb, og_triangle, transforms, colors);
+        });
+    }
 
-int main(){
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+    if(check) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(800,800,"Translation", NULL, NULL);
     if(window == NULL){
@@ -66,83 +74,123 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    std::vector<Point> og_triangle = {
-        {-0.5f, -0.5f},
-        {0.5f, -0.5f},
-        {0.0f, 0.5f}
+    // The one time setup is timed as frame 0: transforming and clipping the instances and
+    // uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+
+    timer.beginCpu("generate");
+    std::vector<float> vertices = {
+        og_triangle[0].x, og_triangle[0].y,
+        og_triangle[1].x, og_triangle[1].y,
+        og_triangle[2].x, og_triangle[2].y
     };
+    std::vector<CompactVertex> compactVertices;
+    size_t vertexCount = 3;
+    PolygonClipStats stats;
+    PolygonArena arena;
+    if(clipMode){
+        stats = clipInstances(og_triangle, transforms, ndcBox, arena);
+        if(compact) clippedVertices(arena, colors, compactVertices);
+        else clippedVertices(arena, colors, vertices);
+        vertexCount = fanVertexCount(arena);
+    }
+    timer.endCpu("generate");
+    if(clipMode){
+        std::cout << stats.accepted << " instances inside, " << stats.clipped << " clipped, " << stats.rejected
+                  << " off screen, " << vertexCount << " vertices uploaded in "
+                  << vertexCount * (compact ? sizeof(CompactVertex) : 5 * sizeof(float)) << " bytes\n";
+    }
 
-    float xf = 0.2f, yf = 0.0f;
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, compact ? &compactClippedVertexShaderSource
+                                    : clipMode ? &clippedVertexShaderSource : &instancedVertexShaderSource, NULL);
+    glCompileShader(vertexShader);
 
-    std::vector<Point> translated_triangle;
-    for(auto& p : og_triangle){
-        translated_triangle.push_back(translate(p,xf,yf));
-    }
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &instancedFragmentShaderSource, NULL);
+    glCompileShader(fragmentShader);
 
-    //Color of original triangle -> white
-    //Color of translated triangle -> green
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
 
-    std::vector<float> vertices = {
-        og_triangle[0].x, og_triangle[0].y, 1.0f, 1.0f, 1.0f,
-        og_triangle[1].x, og_triangle[1].y, 1.0f, 1.0f, 1.0f,
-        og_triangle[2].x, og_triangle[2].y, 1.0f, 1.0f, 1.0f,
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
 
-        translated_triangle[0].x, translated_triangle[0].y, 0.0f, 1.0f, 0.0f,
-        translated_triangle[1].x, translated_triangle[1].y, 0.0f, 1.0f, 0.0f,
-        translated_triangle[2].x, translated_triangle[2].y, 0.0f, 1.0f, 0.0f
-    };
+    glUseProgram(shaderProgram);
 
+    timer.beginCpu("upload");
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    if(compact){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex)*compactVertices.size(), compactVertices.data(), GL_STATIC_DRAW);
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    }
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    if(clipMode){
+        clippedVertexAttribs(compact);
+    }
+    else{
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    int instanceCount = clipMode ? 0 : uploadInstances(shaderProgram, transforms, colors);
+    timer.endCpu("upload");
 
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
+    timer.endFrame();
 
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    while(!glfwWindowShouldClose(window)){
+    bool passed = true;
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
         glBindVertexArray(VAO);
         glUseProgram(shaderProgram);
 
-        glLineWidth(2.0f);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if(clipMode){
+            glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+        }
+        else{
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, instanceCount);
+        }
+        timer.endGpu("draw");
+
+        if(check){
+            passed = checkInstances(og_triangle, transforms, colors, {0.0f, 0.0f, 0.0f}, 800, 800);
+            break;
+        }
 
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
+    }
+    if(!check){
+        redraw.report();
+        timer.report();
     }
+    timer.destroy();
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    return 0;
+    return passed ? 0 : 1;
 }
\ No newline at end of file
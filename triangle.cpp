@@ -4,12 +4,83 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <vector>
+#include <cstring>
+#include "framebuffer.h"
+#include "scene.h"
+#include "redraw.h"
+#include "timing.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
+    requestRedraw(window);
 }
 
-int main(){
+// --scene: every triangle of a scene file is one instance. Its record (x0 x1 x2, y0 y1 y2) is
+// two per instance attributes, so the mapped array goes to glBufferData as it is.
+const char* sceneVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aX;
+layout (location = 1) in vec3 aY;
+
+void main() {
+    gl_Position = vec4(aX[gl_VertexID], aY[gl_VertexID], 0.0, 1.0);
+}
+)";
+
+// Without GL 3.3 there are no instanced attributes, the triangles are unpacked to (x, y) pairs.
+// This path runs on 3.2 contexts, so its shaders are GLSL 1.50 and aPos is bound to location 0
+// before linking.
+const char* sceneUnpackedVertexShaderSource = R"(
+#version 150
+in vec2 aPos;
+
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
+)";
+
+const char* sceneFragmentShaderSource = R"(
+#version 150
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+}
+)";
+
+int main(int argc, char** argv){
+    float triangleVertices[] = {
+        -0.5f, -0.5f, 0.0f, // Bottom left
+         0.5f, -0.5f, 0.0f, // Bottom right
+         0.0f,  0.5f, 0.0f  // Top
+    };
+
+    // --scene file.scene draws the triangles of a scene file instead, read in place from the mapping
+    MappedScene scene;
+    std::string scenePath;
+    bool sceneMode = sceneRequested(argc, argv, scenePath);
+    if(sceneMode && !scene.open(scenePath)){
+        std::cerr << scenePath << ": " << scene.error << "\n";
+        return -1;
+    }
+    ArrayView<Triangle> triangles = scene.view.triangles;
+
+    // --headless [image.ppm|image.png] draws into a software framebuffer instead of a window
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        const float* v = triangleVertices;
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 0.0f, 0.0f));
+            if(!sceneMode) return fillTriangle(fb, v[0], v[1], v[3], v[4], v[6], v[7], rgba(1.0f, 1.0f, 1.0f));
+            size_t pixels = 0;
+            for(const Triangle& t : triangles){
+                pixels += fillTriangle(fb, t.x[0], t.y[0], t.x[1], t.y[1], t.x[2], t.y[2], rgba(1.0f, 1.0f, 1.0f));
+            }
+            return pixels;
+        });
+    }
+
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -31,36 +102,112 @@ int main(){
     glViewport(0, 0, 800, 800);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    float triangleVertices[] = {
-        -0.5f, -0.5f, 0.0f, // Bottom left
-         0.5f, -0.5f, 0.0f, // Bottom right
-         0.0f,  0.5f, 0.0f  // Top
-    };
+    // The one time setup is timed as frame 0: unpacking the scene's triangles when they cannot
+    // be instanced, and uploading them
+    FrameTimer timer;
+    timer.create(argc, argv);
+    timer.beginFrame();
+
+    bool instanced = sceneMode && GLAD_GL_VERSION_3_3;
+    timer.beginCpu("generate");
+    std::vector<float> vertices;
+    if(sceneMode && !instanced){
+        vertices.reserve(triangles.size() * 6);
+        for(const Triangle& t : triangles){
+            for(int k=0;k<3;k++){
+                vertices.push_back(t.x[k]);
+                vertices.push_back(t.y[k]);
+            }
+        }
+    }
+    timer.endCpu("generate");
 
+    timer.beginCpu("upload");
     unsigned int triangleVAO, triangleVBO;
     glGenVertexArrays(1, &triangleVAO);
     glGenBuffers(1, &triangleVBO);
 
     glBindVertexArray(triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    if(instanced){
+        static_assert(sizeof(Triangle) == 6 * sizeof(float), "triangles are uploaded as six floats");
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * triangles.size(), triangles.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Triangle), (void*)offsetof(Triangle, x));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Triangle), (void*)offsetof(Triangle, y));
+        glVertexAttribDivisor(0, 1);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(1);
+    }
+    else if(sceneMode){
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    }
+    else{
+        glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    }
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    timer.endCpu("upload");
+
+    unsigned int shaderProgram = 0;
+    if(sceneMode){
+        unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, instanced ? &sceneVertexShaderSource : &sceneUnpackedVertexShaderSource, NULL);
+        glCompileShader(vertexShader);
+
+        unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &sceneFragmentShaderSource, NULL);
+        glCompileShader(fragmentShader);
+
+        shaderProgram = glCreateProgram();
+        glAttachShader(shaderProgram, vertexShader);
+        glAttachShader(shaderProgram, fragmentShader);
+        if(!instanced){
+            glBindAttribLocation(shaderProgram, 0, "aPos");
+        }
+        glLinkProgram(shaderProgram);
+
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+    }
+
+    timer.endFrame();
 
-    while(!glfwWindowShouldClose(window)){
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
         glBindVertexArray(triangleVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
+        if(instanced){
+            glUseProgram(shaderProgram);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, triangles.size());
+        }
+        else if(sceneMode){
+            glUseProgram(shaderProgram);
+            glDrawArrays(GL_TRIANGLES, 0, triangles.size() * 3);
+        }
+        else{
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
+    if(sceneMode) glDeleteProgram(shaderProgram);
     glDeleteVertexArrays(1, &triangleVAO);
     glDeleteBuffers(1, &triangleVBO);
     glfwDestroyWindow(window);
@@ -3,8 +3,20 @@
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include "framebuffer.h"
+#include "redraw.h"
+#include "timing.h"
 
-int main(){
+int main(int argc, char** argv){
+    // --headless [image.ppm|image.png] clears a software framebuffer instead of opening a window
+    std::string imagePath;
+    if(headlessRequested(argc, argv, imagePath)){
+        Framebuffer fb(800, 800);
+        return renderHeadless(fb, imagePath, [&]{
+            fb.clear(rgba(0.0f, 1.0f, 1.0f));
+            return fb.pixels.size();
+        });
+    }
 
     glfwInit();
 
@@ -27,11 +39,23 @@ int main(){
 
     glClearColor(0.0f,1.0f,1.0f,1.0f);
 
-    while(!glfwWindowShouldClose(window)){
+    Redraw redraw;
+    redraw.attach(window, continuousRequested(argc, argv));
+    FrameTimer timer;
+    timer.create(argc, argv);
+    while(redraw.next(window)){
+        timer.beginFrame();
+        timer.beginGpu("draw");
         glClear(GL_COLOR_BUFFER_BIT);
+        timer.endGpu("draw");
+        timer.beginCpu("swap");
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        timer.endCpu("swap");
+        timer.endFrame();
     }
+    redraw.report();
+    timer.report();
+    timer.destroy();
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,204 @@
+//Anti-aliased lines with Xiaolin Wu's algorithm
+//Coordinates are in pixels of the 800x800 window, output is (pixel, coverage) pairs
+
+#pragma once
+
+#include "lines.h"
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Coverage output of a batch, one array per field so SIMD lanes store contiguously. Segment i
+// owns entries [first[i], first[i] + count[i]): for each pixel step along the major axis the
+// pixel the ideal line passes below and then, count[i] / 2 entries later, the one above it.
+struct CoverageBatch{
+    std::vector<int> x, y;
+    std::vector<float> coverage;
+    std::vector<int> first;
+    std::vector<int> count;
+
+    size_t size() const{
+        return coverage.size();
+    }
+};
+
+// Wu covers two pixels per step, dMajor + 1 steps with the end points at pixel centers
+inline int wuPixelCount(const Segment& s){
+    return 2 * bresenhamPixelCount(s);
+}
+
+// Step i of the walk is at major coordinate a1 + i * majorStep, and the ideal line is at
+// minor coordinate b1 + i * gradient there. Its two neighbouring pixel rows (or columns) split
+// the pixel by the fractional part. Evaluated from i rather than accumulated, so long lines do
+// not drift and the SIMD lanes give exactly the scalar result.
+struct WuSetup{
+    bool xMajor;
+    int a1, b1, majorStep, steps;
+    float gradient;
+};
+
+inline WuSetup wuSetup(const Segment& s){
+    int dx = s.x2 - s.x1, dy = s.y2 - s.y1;
+    WuSetup w;
+    w.xMajor = std::abs(dx) >= std::abs(dy);
+    int dMajor = w.xMajor ? dx : dy, dMinor = w.xMajor ? dy : dx;
+    w.a1 = w.xMajor ? s.x1 : s.y1;
+    w.b1 = w.xMajor ? s.y1 : s.x1;
+    w.majorStep = dMajor >= 0 ? 1 : -1;
+    w.steps = std::abs(dMajor) + 1;
+    w.gradient = dMajor == 0 ? 0.0f : (float)dMinor / std::abs(dMajor);
+    return w;
+}
+
+// Writes the coverage of one segment at entry offset of batch, scalar reference
+inline void wuSegment(const Segment& s, CoverageBatch& batch, size_t offset){
+    WuSetup w = wuSetup(s);
+    int* lowA = (w.xMajor ? batch.x.data() : batch.y.data()) + offset;
+    int* lowB = (w.xMajor ? batch.y.data() : batch.x.data()) + offset;
+    float* lowC = batch.coverage.data() + offset;
+    int* highA = lowA + w.steps;
+    int* highB = lowB + w.steps;
+    float* highC = lowC + w.steps;
+
+    for(int i=0;i<w.steps;i++){
+        float b = (float)w.b1 + (float)i * w.gradient;
+        float base = std::floor(b);
+        float f = b - base;
+        int a = w.a1 + i * w.majorStep;
+        lowA[i] = a;
+        lowB[i] = (int)base;
+        lowC[i] = 1.0f - f;
+        highA[i] = a;
+        highB[i] = (int)base + 1;
+        highC[i] = f;
+    }
+}
+
+#if defined(__AVX2__)
+const int wuLanes = 8;
+#elif defined(__SSE2__)
+const int wuLanes = 4;
+#else
+const int wuLanes = 1;
+#endif
+
+// wuSegment with wuLanes steps at a time. The float operations are the ones of the scalar
+// loop, floor done as truncation corrected for negative values, so both give the same output.
+inline void wuSegmentSimd(const Segment& s, CoverageBatch& batch, size_t offset){
+    WuSetup w = wuSetup(s);
+    int* lowA = (w.xMajor ? batch.x.data() : batch.y.data()) + offset;
+    int* lowB = (w.xMajor ? batch.y.data() : batch.x.data()) + offset;
+    float* lowC = batch.coverage.data() + offset;
+    int* highA = lowA + w.steps;
+    int* highB = lowB + w.steps;
+    float* highC = lowC + w.steps;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i a = _mm256_add_epi32(_mm256_set1_epi32(w.a1), _mm256_mullo_epi32(lane, _mm256_set1_epi32(w.majorStep)));
+    __m256i aStep = _mm256_set1_epi32(8 * w.majorStep), one = _mm256_set1_epi32(1);
+    __m256 b1 = _mm256_set1_ps((float)w.b1), gradient = _mm256_set1_ps(w.gradient), full = _mm256_set1_ps(1.0f);
+
+    for(;i+8<=w.steps;i+=8){
+        __m256 index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lane));
+        __m256 b = _mm256_add_ps(b1, _mm256_mul_ps(index, gradient));
+        __m256i base = _mm256_cvttps_epi32(b);
+        // Truncation rounded up for negative values, take one off there
+        base = _mm256_add_epi32(base, _mm256_castps_si256(_mm256_cmp_ps(_mm256_cvtepi32_ps(base), b, _CMP_GT_OQ)));
+        __m256 f = _mm256_sub_ps(b, _mm256_cvtepi32_ps(base));
+
+        _mm256_storeu_si256((__m256i*)(lowA + i), a);
+        _mm256_storeu_si256((__m256i*)(lowB + i), base);
+        _mm256_storeu_ps(lowC + i, _mm256_sub_ps(full, f));
+        _mm256_storeu_si256((__m256i*)(highA + i), a);
+        _mm256_storeu_si256((__m256i*)(highB + i), _mm256_add_epi32(base, one));
+        _mm256_storeu_ps(highC + i, f);
+        a = _mm256_add_epi32(a, aStep);
+    }
+#elif defined(__SSE2__)
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i a = _mm_setr_epi32(w.a1, w.a1 + w.majorStep, w.a1 + 2 * w.majorStep, w.a1 + 3 * w.majorStep);
+    __m128i aStep = _mm_set1_epi32(4 * w.majorStep), one = _mm_set1_epi32(1);
+    __m128 b1 = _mm_set1_ps((float)w.b1), gradient = _mm_set1_ps(w.gradient), full = _mm_set1_ps(1.0f);
+
+    for(;i+4<=w.steps;i+=4){
+        __m128 index = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), lane));
+        __m128 b = _mm_add_ps(b1, _mm_mul_ps(index, gradient));
+        __m128i base = _mm_cvttps_epi32(b);
+        // Truncation rounded up for negative values, take one off there
+        base = _mm_add_epi32(base, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(base), b)));
+        __m128 f = _mm_sub_ps(b, _mm_cvtepi32_ps(base));
+
+        _mm_storeu_si128((__m128i*)(lowA + i), a);
+        _mm_storeu_si128((__m128i*)(lowB + i), base);
+        _mm_storeu_ps(lowC + i, _mm_sub_ps(full, f));
+        _mm_storeu_si128((__m128i*)(highA + i), a);
+        _mm_storeu_si128((__m128i*)(highB + i), _mm_add_epi32(base, one));
+        _mm_storeu_ps(highC + i, f);
+        a = _mm_add_epi32(a, aStep);
+    }
+#endif
+
+    // Remaining steps, or all of them without SIMD
+    for(;i<w.steps;i++){
+        float b = (float)w.b1 + (float)i * w.gradient;
+        float base = std::floor(b);
+        float f = b - base;
+        int a = w.a1 + i * w.majorStep;
+        lowA[i] = a;
+        lowB[i] = (int)base;
+        lowC[i] = 1.0f - f;
+        highA[i] = a;
+        highB[i] = (int)base + 1;
+        highC[i] = f;
+    }
+}
+
+// Coverage of a whole buffer of segments, sized from the exact counts and filled in parallel
+// like bresenhamBatch. Simd = false runs the scalar loop on every segment.
+template<bool Simd = true>
+inline void wuBatch(ArrayView<Segment> segments, CoverageBatch& batch, unsigned threads = 0){
+    size_t n = segments.size();
+    batch.first.resize(n);
+    batch.count.resize(n);
+
+    size_t total = 0;
+    for(size_t i=0;i<n;i++){
+        batch.first[i] = (int)total;
+        batch.count[i] = wuPixelCount(segments[i]);
+        total += batch.count[i];
+    }
+    batch.x.resize(total);
+    batch.y.resize(total);
+    batch.coverage.resize(total);
+
+    parallelRanges(batch.first, total, threads, [&](size_t begin, size_t end){
+        for(size_t i=begin;i<end;i++){
+            if(Simd) wuSegmentSimd(segments[i], batch, batch.first[i]);
+            else wuSegment(segments[i], batch, batch.first[i]);
+        }
+    });
+}
+
+// Coverage as GL_POINTS vertices (x, y, coverage) at pixel centers in NDC, for drawing with
+// alpha blending where multisampling is not available
+inline std::vector<float> coverageToPoints(const CoverageBatch& batch){
+    std::vector<float> points(batch.size() * 3);
+    for(size_t i=0;i<batch.size();i++){
+        points[i*3] = (batch.x[i] + 0.5f) / 400.0f - 1.0f;
+        points[i*3+1] = (batch.y[i] + 0.5f) / 400.0f - 1.0f;
+        points[i*3+2] = batch.coverage[i];
+    }
+    return points;
+}
+
+// --aa anywhere on the command line
+inline bool antialiasRequested(int argc, char** argv){
+    for(int i=1;i<argc;i++){
+        if(std::strcmp(argv[i], "--aa") == 0) return true;
+    }
+    return false;
+}